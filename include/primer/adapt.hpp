@@ -27,13 +27,18 @@ PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/expected.hpp>
 #include <primer/lua.hpp>
+#include <primer/primer_fwd.hpp>
+#include <primer/push.hpp>
 #include <primer/read.hpp>
 #include <primer/result.hpp>
 
 #include <primer/detail/count.hpp>
+#include <primer/detail/fast_read.hpp>
 #include <primer/detail/max_int.hpp>
+#include <primer/detail/type_traits.hpp>
 #include <primer/support/implement_result.hpp>
 
+#include <tuple>
 #include <type_traits>
 #include <utility>
 
@@ -61,9 +66,33 @@ template <lua_CFunction target_func>
 class adapt<lua_CFunction, target_func> {
 public:
   static int adapted(lua_State * L) { return target_func(L); }
+  //<-
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    return primer::return_or_yield{target_func(L), true, nullptr, 0};
+  }
+  //->
 };
 //]
 
+namespace detail {
+
+// `primer::varargs` may only appear as the last parameter
+template <typename... Args>
+struct varargs_is_last;
+
+template <>
+struct varargs_is_last<> : std::true_type {};
+
+template <typename T>
+struct varargs_is_last<T> : std::true_type {};
+
+template <typename T, typename U, typename... Args>
+struct varargs_is_last<T, U, Args...>
+  : std::integral_constant<bool, !std::is_same<remove_cv_t<T>, varargs>::value
+                                   && varargs_is_last<U, Args...>::value> {};
+
+} // end namespace detail
+
 /***
  * Implementation for a "free" function, using `primer::result` return type.
  */
@@ -85,6 +114,32 @@ class adapt<primer::result (*)(lua_State * L, Args...), target_func> {
     // from propagating to lua.
 
     static primer::result adapted(lua_State * L) noexcept {
+      return dispatch(L, detail::all_fast_read<Args...>{});
+    }
+
+    // Fast path: check the types of all arguments in one sweep, against a
+    // mask computed at compile-time, then read them without further checks.
+    // If anything is wrong, take the slow path to get the error message.
+    static primer::result dispatch(lua_State * L, std::true_type) noexcept {
+      constexpr unsigned masks[] = {0u, detail::fast_read<Args>::mask...};
+      for (int i = 1; i <= static_cast<int>(sizeof...(Args)); ++i) {
+        if (!(detail::lua_type_bit(lua_type(L, i)) & masks[i])) {
+          return dispatch(L, std::false_type{});
+        }
+      }
+
+      std::tuple<detail::fast_arg<Args>...> args{
+        detail::fast_arg<Args>{L, static_cast<int>(indices) + 1}...};
+      const bool checks[] = {true, std::get<indices>(args).check()...};
+      for (bool b : checks) {
+        if (!b) { return dispatch(L, std::false_type{}); }
+      }
+
+      return target_func(L, std::get<indices>(args).get()...);
+    }
+
+    // Slow path: read each argument with primer::read
+    static primer::result dispatch(lua_State * L, std::false_type) noexcept {
       // Create a flag that all the readers can use in order to signal an error
       expected<void> ok;
       // indices + 1 is because lua counts from 1
@@ -121,8 +176,13 @@ class adapt<primer::result (*)(lua_State * L, Args...), target_func> {
     }
   };
 
+  static_assert(detail::varargs_is_last<Args...>::value,
+                "primer::varargs must be the last parameter");
+
 public:
-  static int adapted(lua_State * L) {
+  // Call the function and consume its result, but don't signal it to lua yet.
+  // This is step one of `implement_result`.
+  static primer::return_or_yield adapted_result(lua_State * L) {
     // Estimate how much stack space we will need to read the arguments.
     // If we don't have enough, then signal an error
     // We are guaranteed at least LUA_MINSTACK by the implementation whenever
@@ -131,17 +191,119 @@ public:
       detail::max_int(0, stack_space_for_read<Args>()...);
     if (estimate > LUA_MINSTACK) {
       if (!lua_checkstack(L, estimate)) {
-        return luaL_error(L, "not enough stack space, needed %d", estimate);
+        luaL_error(L, "not enough stack space, needed %d", estimate);
       }
     }
 
     using I = detail::Count_t<sizeof...(Args)>;
 
-    auto temp = detail::implement_result_step_one(L, impl<I>::adapted(L));
-    // primer::result is destroyed at the end of "full expression" in the above
-    // line, so it is safe to longjmp after this.
+    return detail::implement_result_step_one(L, impl<I>::adapted(L));
+  }
+
+  static int adapted(lua_State * L) {
+    auto temp = adapted_result(L);
+    // primer::result is destroyed before adapted_result returns, so it is
+    // safe to longjmp after this.
     return detail::implement_result_step_two(L, temp);
   }
 };
 
+/***
+ * Functions returning several values, as `std::tuple` or `std::pair`, or as
+ * `expected` of those, which may also signal an error.
+ *
+ * The elements are pushed in order, after checking for enough stack space,
+ * and the function is otherwise adapted like one returning `primer::result`.
+ */
+
+namespace detail {
+
+template <typename R>
+struct return_values;
+
+template <typename... Ts>
+struct return_values<std::tuple<Ts...>> {
+  template <std::size_t... Is>
+  static primer::result push_impl(lua_State * L, std::tuple<Ts...> & t,
+                                  SizeList<Is...>) {
+    constexpr int space = primer::stack_space_for_push_each<Ts...>();
+    if (!lua_checkstack(L, space)) {
+      return primer::error::insufficient_stack_space(space);
+    }
+    primer::push_each(L, std::get<Is>(t)...);
+    return static_cast<int>(sizeof...(Ts));
+  }
+
+  static primer::result push(lua_State * L, std::tuple<Ts...> t) {
+    return push_impl(L, t, Count_t<sizeof...(Ts)>{});
+  }
+};
+
+template <typename T, typename U>
+struct return_values<std::pair<T, U>> {
+  static primer::result push(lua_State * L, std::pair<T, U> p) {
+    constexpr int space = primer::stack_space_for_push_each<T, U>();
+    if (!lua_checkstack(L, space)) {
+      return primer::error::insufficient_stack_space(space);
+    }
+    primer::push_each(L, p.first, p.second);
+    return 2;
+  }
+};
+
+template <typename R>
+struct return_values<expected<R>> {
+  static primer::result push(lua_State * L, expected<R> e) {
+    if (!e) { return std::move(e.err()); }
+    return return_values<R>::push(L, std::move(*e));
+  }
+};
+
+// Adapt `f` by wrapping it in a function returning primer::result
+template <typename F, F f>
+struct adapt_return_values;
+
+template <typename R, typename... Args, R (*f)(lua_State *, Args...)>
+struct adapt_return_values<R (*)(lua_State *, Args...), f> {
+  static primer::result call(lua_State * L, Args... args) {
+    return return_values<R>::push(L, f(L, std::forward<Args>(args)...));
+  }
+
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    return adapt<primer::result (*)(lua_State *, Args...),
+                 &call>::adapted_result(L);
+  }
+
+  static int adapted(lua_State * L) {
+    return adapt<primer::result (*)(lua_State *, Args...), &call>::adapted(L);
+  }
+};
+
+} // end namespace detail
+
+template <typename... Ts, typename... Args,
+          std::tuple<Ts...> (*target_func)(lua_State * L, Args...)>
+class adapt<std::tuple<Ts...> (*)(lua_State * L, Args...), target_func>
+  : public detail::adapt_return_values<
+      std::tuple<Ts...> (*)(lua_State * L, Args...), target_func> {};
+
+template <typename T, typename U, typename... Args,
+          std::pair<T, U> (*target_func)(lua_State * L, Args...)>
+class adapt<std::pair<T, U> (*)(lua_State * L, Args...), target_func>
+  : public detail::adapt_return_values<
+      std::pair<T, U> (*)(lua_State * L, Args...), target_func> {};
+
+template <typename... Ts, typename... Args,
+          expected<std::tuple<Ts...>> (*target_func)(lua_State * L, Args...)>
+class adapt<expected<std::tuple<Ts...>> (*)(lua_State * L, Args...),
+            target_func>
+  : public detail::adapt_return_values<
+      expected<std::tuple<Ts...>> (*)(lua_State * L, Args...), target_func> {};
+
+template <typename T, typename U, typename... Args,
+          expected<std::pair<T, U>> (*target_func)(lua_State * L, Args...)>
+class adapt<expected<std::pair<T, U>> (*)(lua_State * L, Args...), target_func>
+  : public detail::adapt_return_values<
+      expected<std::pair<T, U>> (*)(lua_State * L, Args...), target_func> {};
+
 } // end namespace primer
@@ -0,0 +1,194 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * PRIMER_ADAPT_COMPACT is an alternative to PRIMER_ADAPT, which produces less
+ * code for each function.
+ *
+ * PRIMER_ADAPT generates the code which reads and checks the arguments inside
+ * of each adapted function. PRIMER_ADAPT_COMPACT only generates a table with
+ * one entry per parameter, which holds a reader and a destructor for its
+ * type. The readers are shared by all functions with a parameter of that type,
+ * and a loop which is shared by all functions runs them and cleans up.
+ *
+ * The arguments are read with `primer::read`, so the error messages are the
+ * same, but there is no fast path for simple types. This is appropriate for
+ * the many callbacks of an api where binary size matters more than the cost
+ * of each call.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/error.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/read.hpp>
+#include <primer/result.hpp>
+
+#include <primer/detail/count.hpp>
+#include <primer/detail/max_int.hpp>
+#include <primer/support/implement_result.hpp>
+
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace primer {
+
+namespace detail {
+
+// Type-erased reader of one parameter. The values are read into
+// `expected<T>` objects, constructed in uninitialized storage.
+struct compact_arg {
+  // Constructs the value in `slot` and returns true, or returns false with the
+  // error in `err`, leaving nothing constructed.
+  bool (*read)(lua_State * L, int idx, void * slot, primer::error * err);
+  // Null for trivially destructible values
+  void (*destroy)(void * slot);
+};
+
+template <typename T>
+using compact_slot = typename std::aligned_storage<
+  sizeof(expected<T>), std::alignment_of<expected<T>>::value>::type;
+
+template <typename T>
+struct compact_reader {
+  static bool read(lua_State * L, int idx, void * slot, primer::error * err) {
+    expected<T> * p = new (slot) expected<T>(primer::read<T>(L, idx));
+    if (*p) { return true; }
+    *err = std::move(p->err());
+    p->~expected<T>();
+    return false;
+  }
+
+  static void destroy(void * slot) {
+    static_cast<expected<T> *>(slot)->~expected<T>();
+  }
+
+  static constexpr compact_arg get() {
+    return compact_arg{&compact_reader::read,
+                       std::is_trivially_destructible<expected<T>>::value
+                         ? nullptr
+                         : &compact_reader::destroy};
+  }
+};
+
+inline void
+compact_destroy(const compact_arg * args, int n, void * const * slots) {
+  for (int i = 0; i < n; ++i) {
+    if (args[i].destroy) { args[i].destroy(slots[i]); }
+  }
+}
+
+// Read the arguments at stack positions 1 to n into the slots
+inline bool
+compact_decode(lua_State * L, const compact_arg * args, int n,
+               void * const * slots, primer::error * err) {
+  for (int i = 0; i < n; ++i) {
+    if (!args[i].read(L, i + 1, slots[i], err)) {
+      compact_destroy(args, i, slots);
+      return false;
+    }
+  }
+  return true;
+}
+
+} // end namespace detail
+
+//[ primer_adapt_compact_decl
+template <typename T, T>
+class adapt_compact;
+//]
+
+/***
+ * Raw C functions don't need any work
+ */
+template <lua_CFunction target_func>
+class adapt_compact<lua_CFunction, target_func>
+  : public adapt<lua_CFunction, target_func> {};
+
+/***
+ * Functions returning `primer::result`
+ */
+template <typename... Args,
+          primer::result (*target_func)(lua_State * L, Args...)>
+class adapt_compact<primer::result (*)(lua_State * L, Args...), target_func> {
+
+  template <typename T>
+  struct impl;
+
+  template <std::size_t... indices>
+  struct impl<detail::SizeList<indices...>> {
+    static primer::result call(lua_State * L) noexcept {
+      static constexpr int n = sizeof...(Args);
+
+      // The first entries are placeholders, so that the arrays are not empty
+      static const detail::compact_arg args[] = {
+        detail::compact_arg{nullptr, nullptr},
+        detail::compact_reader<Args>::get()...};
+
+      std::tuple<detail::compact_slot<Args>...> storage;
+      void * const slots[] = {
+        nullptr, static_cast<void *>(&std::get<indices>(storage))...};
+
+      primer::error err;
+      if (!detail::compact_decode(L, args + 1, n, slots + 1, &err)) {
+        return err;
+      }
+
+      primer::result r =
+        target_func(L, (*std::move(*static_cast<expected<Args> *>(
+                          slots[indices + 1])))...);
+      detail::compact_destroy(args + 1, n, slots + 1);
+      return r;
+    }
+  };
+
+  static_assert(detail::varargs_is_last<Args...>::value,
+                "primer::varargs must be the last parameter");
+
+public:
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    constexpr int estimate =
+      detail::max_int(0, stack_space_for_read<Args>()...);
+    if (estimate > LUA_MINSTACK) {
+      if (!lua_checkstack(L, estimate)) {
+        luaL_error(L, "not enough stack space, needed %d", estimate);
+      }
+    }
+
+    using I = detail::Count_t<sizeof...(Args)>;
+    return detail::implement_result_step_one(L, impl<I>::call(L));
+  }
+
+  static int adapted(lua_State * L) {
+    auto temp = adapted_result(L);
+    return detail::implement_result_step_two(L, temp);
+  }
+};
+
+/***
+ * Functions returning tuples, pairs, or `expected` of those, see `adapt`
+ */
+template <typename R, typename... Args,
+          R (*target_func)(lua_State * L, Args...)>
+class adapt_compact<R (*)(lua_State * L, Args...), target_func>
+  : public adapt_compact<
+      primer::result (*)(lua_State * L, Args...),
+      &detail::adapt_return_values<R (*)(lua_State * L, Args...),
+                                   target_func>::call> {};
+
+} // end namespace primer
+
+//[ primer_adapt_compact_macro
+#define PRIMER_ADAPT_COMPACT(F)                                                \
+  &::primer::adapt_compact<decltype(F), (F)>::adapted
+//]
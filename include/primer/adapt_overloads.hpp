@@ -0,0 +1,254 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * PRIMER_ADAPT_OVERLOADS combines several functions, which could each be
+ * passed to PRIMER_ADAPT, into one lua_CFunction.
+ *
+ * The overload is selected from the number and the lua types of the arguments.
+ * For each overload, the set of lua types accepted at each argument position
+ * is computed at compile-time, and the overloads form a decision table. At
+ * run-time, the types of the arguments are computed once and the first
+ * matching row of the table is called, via PRIMER_ADAPT.
+ *
+ * Integers and floating point numbers are distinguished, so that an overload
+ * taking `int` is not selected for 1.5, but an overload taking `double`
+ * accepts both.
+ *
+ * Types without a known lua type, such as containers, match any value. Extra
+ * arguments which are nil are ignored, like in lua. If no overload matches, a
+ * lua error is raised, listing the types of the arguments.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/lua.hpp>
+#include <primer/primer_fwd.hpp>
+
+#include <primer/detail/count.hpp>
+#include <primer/detail/fast_read.hpp>
+#include <primer/detail/max_int.hpp>
+#include <primer/detail/preprocessor.hpp>
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+namespace primer {
+namespace detail {
+
+// Extra bit, set for numbers which have an integer representation
+static constexpr unsigned lua_integer_bit = 1u << 31;
+
+inline unsigned
+overload_arg_bits(lua_State * L, int idx) noexcept {
+  int t = lua_type(L, idx);
+  unsigned result = lua_type_bit(t);
+  if (t == LUA_TNUMBER && lua_isinteger(L, idx)) { result |= lua_integer_bit; }
+  return result;
+}
+
+template <typename T>
+struct is_fast_integer
+  : std::integral_constant<bool, std::is_integral<T>::value
+                                   && !std::is_same<T, bool>::value
+                                   && fast_read<T>::enabled> {};
+
+// The lua types which an argument of type T may be selected for
+template <typename T, typename ENABLE = void>
+struct overload_mask {
+  static constexpr unsigned value = lua_type_any;
+};
+
+template <typename T>
+struct overload_mask<T, enable_if_t<fast_read<T>::enabled
+                                    && !is_fast_integer<T>::value>> {
+  static constexpr unsigned value = fast_read<T>::mask;
+};
+
+template <typename T>
+struct overload_mask<T, enable_if_t<is_fast_integer<T>::value>> {
+  static constexpr unsigned value = lua_integer_bit;
+};
+
+template <>
+struct overload_mask<std::string> {
+  static constexpr unsigned value = lua_type_bit(LUA_TSTRING);
+};
+
+template <typename... Args>
+struct overload_masks;
+
+// Past the last parameter, only nil or "no value" is accepted
+template <>
+struct overload_masks<> {
+  static constexpr unsigned at(std::size_t) {
+    return lua_type_bit(LUA_TNONE) | lua_type_bit(LUA_TNIL);
+  }
+};
+
+// Trailing varargs accept anything
+template <>
+struct overload_masks<varargs> {
+  static constexpr unsigned at(std::size_t) { return lua_type_any; }
+};
+
+template <typename T, typename... Ts>
+struct overload_masks<T, Ts...> {
+  static constexpr unsigned at(std::size_t k) {
+    return k ? overload_masks<Ts...>::at(k - 1) : overload_mask<T>::value;
+  }
+};
+
+// One candidate function
+template <typename F, F f>
+struct overload_target;
+
+template <typename R, typename... Args, R (*f)(lua_State *, Args...)>
+struct overload_target<R (*)(lua_State *, Args...), f> {
+  using masks = overload_masks<remove_cv_t<Args>...>;
+  static constexpr std::size_t arity = sizeof...(Args);
+  static constexpr lua_CFunction adapted =
+    &::primer::adapt<R (*)(lua_State *, Args...), f>::adapted;
+};
+
+// The decision table, row `i` is overload `i`, column `j` is argument `j`.
+template <typename... Targets>
+struct overload_table;
+
+template <>
+struct overload_table<> {
+  static constexpr unsigned at(std::size_t, std::size_t) { return 0; }
+};
+
+template <typename T, typename... Ts>
+struct overload_table<T, Ts...> {
+  static constexpr unsigned at(std::size_t i, std::size_t j) {
+    return i ? overload_table<Ts...>::at(i - 1, j) : T::masks::at(j);
+  }
+};
+
+// Raise an error listing the types of the arguments
+inline int
+overload_error(lua_State * L) {
+  int n = lua_gettop(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  luaL_addstring(&b, "No overload matches arguments (");
+  for (int i = 1; i <= n; ++i) {
+    if (i > 1) { luaL_addstring(&b, ", "); }
+    luaL_addstring(&b, luaL_typename(L, i));
+  }
+  luaL_addstring(&b, ")");
+  luaL_pushresult(&b);
+  return lua_error(L);
+}
+
+} // end namespace detail
+
+//[ primer_adapt_overloads
+template <typename... Targets>
+class adapt_overloads {
+  //<-
+  static_assert(sizeof...(Targets) > 0, "need at least one overload");
+
+  static constexpr std::size_t rows = sizeof...(Targets);
+
+  // One column per parameter position, plus one more to reject extra arguments
+  static constexpr std::size_t width =
+    static_cast<std::size_t>(
+      detail::max_int(0, static_cast<int>(Targets::arity)...))
+    + 1;
+
+  template <typename T, typename U>
+  struct impl;
+
+  template <std::size_t... js, std::size_t... ks>
+  struct impl<detail::SizeList<js...>, detail::SizeList<ks...>> {
+    static int adapted(lua_State * L) {
+      using table_t = detail::overload_table<Targets...>;
+      constexpr unsigned table[] = {table_t::at(ks / width, ks % width)...};
+      constexpr lua_CFunction targets[] = {Targets::adapted...};
+
+      const unsigned actual[] = {
+        detail::overload_arg_bits(L, static_cast<int>(js) + 1)...};
+
+      // Arguments past the last column must be nil, unless a row has varargs
+      unsigned rest = 0;
+      for (int k = static_cast<int>(width) + 1; k <= lua_gettop(L); ++k) {
+        if (!lua_isnil(L, k)) {
+          rest = detail::overload_arg_bits(L, k);
+          break;
+        }
+      }
+
+      for (std::size_t i = 0; i < rows; ++i) {
+        bool match = !rest || (rest & table_t::at(i, width));
+        for (std::size_t j = 0; j < width; ++j) {
+          if (!(actual[j] & table[i * width + j])) {
+            match = false;
+            break;
+          }
+        }
+        if (match) { return targets[i](L); }
+      }
+      return detail::overload_error(L);
+    }
+  };
+
+  //->
+public:
+  /*<< Dispatches to the first overload which accepts the arguments >>*/
+  static int adapted(lua_State * L) {
+    using I = impl<detail::Count_t<width>, detail::Count_t<rows * width>>;
+    return I::adapted(L);
+  }
+};
+//]
+
+} // end namespace primer
+
+//[ primer_adapt_overloads_macro
+#define PRIMER_ADAPT_OVERLOADS(...)                                            \
+  &::primer::adapt_overloads<PRIMER_PP_OVERLOAD(                               \
+    PRIMER_ADAPT_OVERLOADS_, __VA_ARGS__)>::adapted
+//]
+
+#define PRIMER_ADAPT_OVERLOAD_TARGET(F)                                        \
+  ::primer::detail::overload_target<decltype(F), (F)>
+
+#define PRIMER_ADAPT_OVERLOADS_1(A) PRIMER_ADAPT_OVERLOAD_TARGET(A)
+#define PRIMER_ADAPT_OVERLOADS_2(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_1(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_3(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_2(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_4(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_3(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_5(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_4(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_6(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_5(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_7(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_6(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_8(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_7(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_9(A, ...)                                       \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_8(__VA_ARGS__))
+#define PRIMER_ADAPT_OVERLOADS_10(A, ...)                                      \
+  PRIMER_ADAPT_OVERLOAD_TARGET(A),                                             \
+    PRIMER_PP_EXPAND(PRIMER_ADAPT_OVERLOADS_9(__VA_ARGS__))
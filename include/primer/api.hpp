@@ -17,13 +17,17 @@ PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/api/base.hpp>
 #include <primer/api/callback_registrar.hpp>
+#include <primer/api/callback_stats.hpp>
 #include <primer/api/callbacks.hpp>
 #include <primer/api/extraspace_dispatch.hpp>
 #include <primer/api/feature.hpp>
+#include <primer/api/lazy_globals.hpp>
 #include <primer/api/libraries.hpp>
 #include <primer/api/no_fs.hpp>
 #include <primer/api/persistable.hpp>
 #include <primer/api/persistent_value.hpp>
 #include <primer/api/print_manager.hpp>
+#include <primer/api/scheduler.hpp>
+#include <primer/api/upvalue_dispatch.hpp>
 #include <primer/api/userdatas.hpp>
 #include <primer/api/vfs.hpp>
@@ -16,6 +16,9 @@
  */
 
 #include <primer/api/extraspace_dispatch.hpp>
+#include <primer/call_stats.hpp>
+#include <primer/result.hpp>
+#include <primer/support/implement_result.hpp>
 
 #include <primer/detail/preprocessor.hpp>
 #include <primer/detail/rank.hpp>
@@ -60,6 +63,34 @@ struct objlist_adaptor<T, TypeList<Ts...>> {
   }
 };
 
+#ifdef PRIMER_CALL_STATS
+
+// Count and time the calls of a callback, in the statistics of this thread.
+// D is the dispatcher of the callback.
+template <const char * (*name)(), typename D>
+struct callback_stats_dispatcher {
+  static int adapted(lua_State * L) {
+    static thread_local call_stats_handle entry = nullptr;
+    if (!entry) { entry = call_stats_callback(name()); }
+
+    call_timer timer{entry};
+    auto temp = D::adapted_result(L);
+    timer.stop(temp.is_valid());
+    return implement_result_step_two(L, temp);
+  }
+};
+
+#define PRIMER_ADAPT_CALLBACK(t, name, f)                                      \
+  &primer::detail::callback_stats_dispatcher<                                  \
+    &t::lua_callback_name_##name,                                              \
+    primer::api::extraspace_dispatcher<t, decltype(f), f>>::adapted
+
+#else // PRIMER_CALL_STATS
+
+#define PRIMER_ADAPT_CALLBACK(t, name, f) PRIMER_ADAPT_EXTRASPACE(t, f)
+
+#endif // PRIMER_CALL_STATS
+
 } // end namespace detail
 
 /***
@@ -104,14 +135,15 @@ public:
 
 /***
  * Use a given function pointer as a callback for this lua owner.
- * The function pointer is wrapped using PRIMER_ADAPT_EXTRASPACE
+ * The function pointer is wrapped using PRIMER_ADAPT_EXTRASPACE, and if
+ * PRIMER_CALL_STATS is defined, its calls are counted and timed.
  */
 
 #define USE_LUA_CALLBACK_3(name, help, fcn)                                    \
   static constexpr const char * lua_callback_name_##name() { return #name; }   \
   static constexpr const char * lua_callback_help_##name() { return help; }    \
   static constexpr lua_CFunction lua_get_fcn_ptr_##name() {                    \
-    return PRIMER_ADAPT_EXTRASPACE(owner_type, fcn);                           \
+    return PRIMER_ADAPT_CALLBACK(owner_type, name, fcn);                       \
   }                                                                            \
   static inline primer::detail::                                               \
     Append_t<GET_CALLBACKS,                                                    \
@@ -0,0 +1,59 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * intf_callback_stats_impl: Respond to a lua query for the statistics of the
+ * api callbacks, which are recorded when `PRIMER_CALL_STATS` is defined.
+ *
+ * Returns a table mapping each callback name to a table with fields `calls`,
+ * `errors` and `time`, the total time in seconds. The statistics are merged
+ * from all threads.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/call_stats.hpp>
+#include <primer/error.hpp>
+#include <primer/lua.hpp>
+#include <primer/result.hpp>
+
+#include <chrono>
+#include <vector>
+
+namespace primer {
+namespace api {
+
+inline primer::result
+intf_callback_stats_impl(lua_State * L) {
+  std::vector<call_stats> stats;
+  PRIMER_TRY_BAD_ALLOC { stats = call_stats::callback_snapshot(); }
+  PRIMER_CATCH_BAD_ALLOC { return primer::error::bad_alloc(); }
+
+  if (!lua_checkstack(L, 3)) {
+    return primer::error::insufficient_stack_space(3);
+  }
+
+  lua_createtable(L, 0, static_cast<int>(stats.size()));
+  for (const auto & s : stats) {
+    using seconds = std::chrono::duration<lua_Number>;
+
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, static_cast<lua_Integer>(s.calls));
+    lua_setfield(L, -2, "calls");
+    lua_pushinteger(L, static_cast<lua_Integer>(s.errors));
+    lua_setfield(L, -2, "errors");
+    lua_pushnumber(L, std::chrono::duration_cast<seconds>(s.total).count());
+    lua_setfield(L, -2, "time");
+    lua_setfield(L, -2, s.name.c_str());
+  }
+  return 1;
+}
+
+} // end namespace api
+} // end namespace primer
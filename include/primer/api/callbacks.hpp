@@ -32,6 +32,7 @@ PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/api/callback_registrar.hpp>
 #include <primer/api/help.hpp>
+#include <primer/api/lazy_globals.hpp>
 
 #include <primer/detail/span.hpp>
 
@@ -43,13 +44,16 @@ class callbacks {
 
   detail::span<const luaW_Reg> list_;
   void * owner_ptr_;
+  const char * module_;
 
 public:
   template <typename T>
   constexpr explicit callbacks(const detail::span<const luaW_Reg> & _l,
-                               T * _owner_ptr)
+                               T * _owner_ptr,
+                               const char * _module = nullptr)
     : list_(_l)
-    , owner_ptr_(static_cast<void *>(_owner_ptr)) {}
+    , owner_ptr_(static_cast<void *>(_owner_ptr))
+    , module_(_module) {}
 
   // This is the ctor you should usually use, when using this
   // with an api_base object
@@ -57,6 +61,12 @@ public:
   constexpr explicit callbacks(T * _owner_ptr)
     : callbacks(T::callbacks_array(), _owner_ptr) {}
 
+  // Place the callbacks in a table, which is the global `_module`, rather than
+  // in the global table
+  template <typename T>
+  constexpr explicit callbacks(T * _owner_ptr, const char * _module)
+    : callbacks(T::callbacks_array(), _owner_ptr, _module) {}
+
   //
   // API Feature
   //
@@ -65,13 +75,26 @@ public:
     // Initialize the extraspace to point to the owner
     detail::access_extraspace_ptr(L) = owner_ptr_;
 
+    if (module_) {
+      // The size of the module table is known, so create it at full size
+      lua_createtable(L, 0, static_cast<int>(list_.size()));
+    } else {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+    }
+
     for (const auto & r : list_) {
       if (r.func) {
         api::set_help_string(L, r.func, r.help);
         lua_pushcfunction(L, r.func);
-        lua_setglobal(L, r.name);
+        lua_setfield(L, -2, r.name);
       }
     }
+
+    if (module_) {
+      lua_setglobal(L, module_);
+    } else {
+      lua_pop(L, 1);
+    }
   }
 
   // Register as func - name pairs
@@ -81,6 +104,96 @@ public:
   void on_unpersist_table(lua_State * L) const { set_funcs(L, list_); }
 };
 
+/***
+ * lazy_callbacks is like callbacks, but a callback only becomes a global, and
+ * its help string is only registered, when it is first looked up.
+ * See <primer/api/lazy_globals.hpp>.
+ *
+ * Use it in place of callbacks, with the class deriving from api::base as the
+ * template parameter.
+ */
+
+template <typename T>
+class lazy_callbacks {
+
+  void * owner_ptr_;
+
+  // The upvalue maps the names of the callbacks to their (1-based) positions
+  // in `callbacks_array`. [k]
+  static int loader(lua_State * L) {
+    lua_settop(L, 1);
+    if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNUMBER) { return 0; }
+
+    const auto & arr = T::callbacks_array();
+    const lua_Integer i = lua_tointeger(L, -1);
+    if (i < 1 || static_cast<std::size_t>(i) > arr.size()) { return 0; }
+
+    const auto & r = arr[static_cast<int>(i - 1)];
+    api::set_help_string(L, r.func, r.help);
+    lua_pushcfunction(L, r.func);
+    return 1;
+  }
+
+  static void push_names(lua_State * L) {
+    const auto & arr = T::callbacks_array();
+    lua_createtable(L, 0, static_cast<int>(arr.size()));
+    for (int i = 0; i < static_cast<int>(arr.size()); ++i) {
+      if (arr[i].func) {
+        lua_pushinteger(L, i + 1);
+        lua_setfield(L, -2, arr[i].name);
+      }
+    }
+  }
+
+  static constexpr const char * loader_name = "primer_lazy_callbacks";
+
+public:
+  explicit lazy_callbacks(T * _owner_ptr)
+    : owner_ptr_(static_cast<void *>(_owner_ptr)) {}
+
+  //
+  // API Feature
+  //
+
+  void on_init(lua_State * L) const {
+    detail::access_extraspace_ptr(L) = owner_ptr_;
+    push_names(L);
+    api::add_lazy_global_loader(L, &lazy_callbacks::loader, 1);
+  }
+
+  void on_persist_table(lua_State * L) const {
+    set_funcs_reverse(L, T::callbacks_array());
+    api::lazy_global_loader_perms(L, &lazy_callbacks::loader, loader_name,
+                                  false);
+  }
+
+  void on_unpersist_table(lua_State * L) const {
+    set_funcs(L, T::callbacks_array());
+    api::lazy_global_loader_perms(L, &lazy_callbacks::loader, loader_name,
+                                  true);
+  }
+
+  // Help strings are not persisted, so restore those of the callbacks which
+  // were already created
+  void on_serialize(lua_State * L) const { lua_pushnil(L); }
+
+  void on_deserialize(lua_State * L) const {
+    lua_pop(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+    for (const auto & r : T::callbacks_array()) {
+      if (r.func) {
+        lua_pushstring(L, r.name);
+        lua_rawget(L, -2);
+        if (lua_tocfunction(L, -1) == r.func) {
+          api::set_help_string(L, r.func, r.help);
+        }
+        lua_pop(L, 1);
+      }
+    }
+    lua_pop(L, 1);
+  }
+};
+
 } // end namespace api
 
 } // end namespace primer
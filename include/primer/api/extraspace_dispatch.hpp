@@ -70,6 +70,11 @@ struct extraspace_dispatcher<T, R (T::*)(lua_State *, Args...), target_func> {
     return (object_ptr->*target_func)(L, std::forward<Args>(args)...);
   }
 
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    using helper_t = adapt<R (*)(lua_State *, Args...), dispatch_target>;
+    return helper_t::adapted_result(L);
+  }
+
   static int adapted(lua_State * L) {
     using helper_t = adapt<R (*)(lua_State *, Args...), dispatch_target>;
     return helper_t::adapted(L);
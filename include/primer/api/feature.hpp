@@ -71,39 +71,40 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/support/diagnostics.hpp>
 
 #include <type_traits>
+#include <utility>
 
 namespace primer {
 
 namespace api {
 
 // Trait which validates that a type is an API feature
+//
+// These use std::declval, since calling a member function through a null
+// pointer, even unevaluated, trips gcc's -Wnonnull.
 template <typename T, typename ENABLE = void>
 struct has_on_init_method : std::false_type {};
 
 template <typename T>
-struct has_on_init_method<T, decltype(static_cast<T *>(nullptr)->on_init(
-                                        static_cast<lua_State *>(nullptr)),
-                                      void())> : std::true_type {};
+struct has_on_init_method<
+  T, decltype(std::declval<T &>().on_init(std::declval<lua_State *>()), void())>
+  : std::true_type {};
 
 template <typename T, typename ENABLE = void>
 struct has_on_persist_table_method : std::false_type {};
 
 template <typename T>
-struct has_on_persist_table_method<T, decltype(
-                                        static_cast<T *>(nullptr)
-                                          ->on_persist_table(
-                                            static_cast<lua_State *>(nullptr)),
-                                        void())> : std::true_type {};
+struct has_on_persist_table_method<
+  T, decltype(std::declval<T &>().on_persist_table(std::declval<lua_State *>()),
+              void())> : std::true_type {};
 
 template <typename T, typename ENABLE = void>
 struct has_on_unpersist_table_method : std::false_type {};
 
 template <typename T>
-struct has_on_unpersist_table_method<T, decltype(static_cast<T *>(nullptr)
-                                                   ->on_unpersist_table(
-                                                     static_cast<lua_State *>(
-                                                       nullptr)),
-                                                 void())> : std::true_type {};
+struct has_on_unpersist_table_method<
+  T,
+  decltype(std::declval<T &>().on_unpersist_table(std::declval<lua_State *>()),
+           void())> : std::true_type {};
 
 // Trait which validates that a type is an API feature
 
@@ -111,31 +112,26 @@ template <typename T, typename ENABLE = void>
 struct is_feature : std::false_type {};
 
 template <typename T>
-struct is_feature<T, decltype(static_cast<T *>(nullptr)->on_init(
-                                static_cast<lua_State *>(nullptr)),
-                              static_cast<T *>(nullptr)->on_persist_table(
-                                static_cast<lua_State *>(nullptr)),
-                              static_cast<T *>(nullptr)->on_unpersist_table(
-                                static_cast<lua_State *>(nullptr)),
-                              void())> : std::true_type {};
+struct is_feature<
+  T,
+  decltype(std::declval<T &>().on_init(std::declval<lua_State *>()),
+           std::declval<T &>().on_persist_table(std::declval<lua_State *>()),
+           std::declval<T &>().on_unpersist_table(std::declval<lua_State *>()),
+           void())> : std::true_type {};
 
 // Trait which validates that a type is a serial feature
 template <typename T, typename ENABLE = void>
 struct is_serial_feature : std::false_type {};
 
 template <typename T>
-struct is_serial_feature<T,
-                         decltype(static_cast<T *>(nullptr)->on_init(
-                                    static_cast<lua_State *>(nullptr)),
-                                  static_cast<T *>(nullptr)->on_persist_table(
-                                    static_cast<lua_State *>(nullptr)),
-                                  static_cast<T *>(nullptr)->on_unpersist_table(
-                                    static_cast<lua_State *>(nullptr)),
-                                  static_cast<T *>(nullptr)->on_serialize(
-                                    static_cast<lua_State *>(nullptr)),
-                                  static_cast<T *>(nullptr)->on_deserialize(
-                                    static_cast<lua_State *>(nullptr)),
-                                  void())> : std::true_type {};
+struct is_serial_feature<
+  T,
+  decltype(std::declval<T &>().on_init(std::declval<lua_State *>()),
+           std::declval<T &>().on_persist_table(std::declval<lua_State *>()),
+           std::declval<T &>().on_unpersist_table(std::declval<lua_State *>()),
+           std::declval<T &>().on_serialize(std::declval<lua_State *>()),
+           std::declval<T &>().on_deserialize(std::declval<lua_State *>()),
+           void())> : std::true_type {};
 
 // Ptr to member type, for use in type lists
 
@@ -0,0 +1,150 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Support for globals which are created on first access.
+ *
+ * The global table gets a metatable, whose `__index` function asks a list of
+ * "loaders" for the missing value. A loader is a C function (possibly with
+ * upvalues) which takes the name and returns the value, or nothing if it
+ * doesn't know the name. The first value found is stored in the global table,
+ * so that the lookup only happens once per name.
+ *
+ * The metatable and the loaders are stored with the global table, so they are
+ * persisted by eris along with it. The `__index` function and the loaders are
+ * C functions, so the features using them must place them in the permanent
+ * objects table, using `lazy_global_loader_perms`.
+ *
+ * Globals which were not materialized are not visible to `pairs(_G)`. If the
+ * global table already has an `__index` metamethod, then it is kept, and asked
+ * for names which no loader knows. A script which installs its own `__index`
+ * on the global table later should likewise chain to the previous one, or the
+ * globals which were not materialized yet become unavailable.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+#include <primer/support/asserts.hpp>
+
+namespace primer {
+
+namespace detail {
+
+// Key in the metatable of the __index metamethod which was replaced
+static constexpr const char * lazy_globals_next_index =
+  "primer_lazy_globals_next_index";
+
+// The __index metamethod of the global table. [t] [k]
+inline int
+lazy_globals_index(lua_State * L) {
+  lua_settop(L, 2);
+  if (!lua_getmetatable(L, 1)) { return 0; }
+
+  if (lua_type(L, 2) == LUA_TSTRING) {
+    for (lua_Integer i = 1; lua_rawgeti(L, 3, i) != LUA_TNIL; ++i) {
+      lua_pushvalue(L, 2);    // [t] [k] [mt] [loader] [k]
+      lua_call(L, 1, 1);      // [t] [k] [mt] [v]
+      if (!lua_isnil(L, -1)) {
+        lua_pushvalue(L, 2);  // [t] [k] [mt] [v] [k]
+        lua_pushvalue(L, -2); // [t] [k] [mt] [v] [k] [v]
+        lua_rawset(L, 1);     // [t] [k] [mt] [v]
+        return 1;
+      }
+      lua_pop(L, 1); // [t] [k] [mt]
+    }
+    lua_pop(L, 1); // [t] [k] [mt]
+  }
+
+  // Fall back to the previous __index, like lua would have used it
+  switch (lua_getfield(L, 3, lazy_globals_next_index)) {
+    case LUA_TFUNCTION:
+      lua_pushvalue(L, 1);
+      lua_pushvalue(L, 2);
+      lua_call(L, 2, 1);
+      return 1;
+    case LUA_TNIL:
+      return 0;
+    default:
+      lua_pushvalue(L, 2);
+      lua_gettable(L, -2);
+      return 1;
+  }
+}
+
+// Name of the __index function in the permanent objects table
+static constexpr const char * lazy_globals_index_name =
+  "primer_lazy_globals_index";
+
+// Put a function in the (un)persist table on top of the stack
+inline void
+lazy_globals_perm(lua_State * L, lua_CFunction f, const char * name,
+                  bool kv_order) {
+  PRIMER_ASSERT_TABLE(L);
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  if (kv_order) {
+    lua_pushstring(L, name);
+    lua_pushcfunction(L, f);
+  } else {
+    lua_pushcfunction(L, f);
+    lua_pushstring(L, name);
+  }
+  lua_settable(L, -3);
+}
+
+} // end namespace detail
+
+namespace api {
+
+/***
+ * Install a loader for the global table. Like `lua_pushcclosure`, `nup`
+ * upvalues for the loader are popped from the stack.
+ */
+inline void
+add_lazy_global_loader(lua_State * L, lua_CFunction loader, int nup = 0) {
+  lua_pushcclosure(L, loader, nup); // [loader]
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS); // [loader] [_G]
+  if (!lua_getmetatable(L, -1)) {
+    lua_newtable(L);         // [loader] [_G] [mt]
+    lua_pushvalue(L, -1);    // [loader] [_G] [mt] [mt]
+    lua_setmetatable(L, -3); // [loader] [_G] [mt]
+  }
+
+  // Keep an existing __index, unless it is ours
+  lua_getfield(L, -1, "__index"); // [loader] [_G] [mt] [index]
+  if (lua_tocfunction(L, -1) == &detail::lazy_globals_index) {
+    lua_pop(L, 1);
+  } else {
+    lua_setfield(L, -2, detail::lazy_globals_next_index);
+    lua_pushcfunction(L, &detail::lazy_globals_index);
+    lua_setfield(L, -2, "__index");
+  }
+
+  lua_Integer n = static_cast<lua_Integer>(lua_rawlen(L, -1));
+  lua_pushvalue(L, -3);      // [loader] [_G] [mt] [loader]
+  lua_rawseti(L, -2, n + 1); // [loader] [_G] [mt]
+  lua_pop(L, 3);
+}
+
+/***
+ * Register the __index function and a loader in the persist table
+ * (`kv_order = false`) or the unpersist table (`kv_order = true`), which must
+ * be on top of the stack.
+ */
+inline void
+lazy_global_loader_perms(lua_State * L, lua_CFunction loader,
+                         const char * loader_name, bool kv_order) {
+  detail::lazy_globals_perm(L, &detail::lazy_globals_index,
+                            detail::lazy_globals_index_name, kv_order);
+  detail::lazy_globals_perm(L, loader, loader_name, kv_order);
+}
+
+} // end namespace api
+} // end namespace primer
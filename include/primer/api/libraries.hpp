@@ -14,8 +14,11 @@
 
 PRIMER_ASSERT_FILESCOPE;
 
+#include <primer/api/lazy_globals.hpp>
 #include <primer/lua.hpp>
 
+#include <cstring>
+
 namespace primer {
 namespace api {
 
@@ -104,15 +107,16 @@ class libraries {
     lua_pop(L, 1);
   }
 
+protected:
+  // Put the functions of the library on top of the stack into the (un)persist
+  // table below it, and pop the library.
   template <typename T, bool kv_order>
-  static void load_lib_into_table(lua_State * L) {
+  static void lib_into_table(lua_State * L) {
     constexpr const char * fmt = "%s_lib_%s";
     // TODO: It would be nice to understand / recollect why `lua_iscfunction`
     // below is essential. Bugs seem to occur if it is removed.
 
-    PRIMER_ASSERT_TABLE(L);                // [target]
-    PRIMER_ASSERT_STACK_NEUTRAL(L);        // [target]
-    luaL_requiref(L, T::name, T::func, 0); // [target] [lib]
+    PRIMER_ASSERT_TABLE(L);                // [target] [lib]
     lua_pushnil(L);                        // [target] [lib] [nil]
     while (lua_next(L, -2)) {              // [target] [lib] [k] [v]
       if (lua_iscfunction(L, -1) && lua_isstring(L, -2)) { //
@@ -127,6 +131,14 @@ class libraries {
     lua_pop(L, 1);                            // [target]
   }
 
+  template <typename T, bool kv_order>
+  static void load_lib_into_table(lua_State * L) {
+    PRIMER_ASSERT_TABLE(L);                // [target]
+    PRIMER_ASSERT_STACK_NEUTRAL(L);        // [target]
+    luaL_requiref(L, T::name, T::func, 0); // [target] [lib]
+    lib_into_table<T, kv_order>(L);        // [target]
+  }
+
 public:
   void on_init(lua_State * L) {
     int dummy[] = {(load_lib_globally<Ts>(L), 0)..., 0};
@@ -144,6 +156,181 @@ public:
   }
 };
 
+/***
+ * lazy_libraries is like libraries, but a library is only opened when its
+ * global is first looked up, or when it is `require`d. See
+ * <primer/api/lazy_globals.hpp>.
+ *
+ * Libraries with side effects besides their global are still opened eagerly.
+ * These are the base library, whose name is empty, the string library, which
+ * sets the metatable of strings, and the package library, which defines
+ * `require`. When the package library is present, the other libraries are
+ * placed in `package.preload`, so that `require` can open them.
+ *
+ * Only the libraries which have been opened are placed in the persist table,
+ * since the others cannot be referred to by the persisted state. Which ones
+ * were opened is serialized with the state, and the unpersist table holds all
+ * of them, without registering them as loaded.
+ */
+
+template <typename... Ts>
+class lazy_libraries : public libraries<Ts...> {
+
+  using base_t = libraries<Ts...>;
+
+  template <typename T>
+  static bool is_eager_lib() {
+    return !*T::name || !std::strcmp(T::name, LUA_STRLIBNAME)
+           || !std::strcmp(T::name, LUA_LOADLIBNAME);
+  }
+
+  template <typename T>
+  static bool is_lib_loaded(lua_State * L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    const bool result = lua_getfield(L, -1, T::name) != LUA_TNIL;
+    lua_pop(L, 2);
+    return result;
+  }
+
+  template <typename T>
+  static void load_eager_lib(lua_State * L) {
+    if (is_eager_lib<T>()) {
+      luaL_requiref(L, T::name, T::func, 1);
+      lua_pop(L, 1);
+    }
+  }
+
+  // Expects package.preload on top of the stack
+  template <typename T>
+  static void preload_lib(lua_State * L) {
+    if (!is_eager_lib<T>()) {
+      lua_pushcfunction(L, &lazy_libraries::preloader);
+      lua_setfield(L, -2, T::name);
+    }
+  }
+
+  template <typename T>
+  static bool try_load_lib(lua_State * L, const char * name) {
+    if (is_eager_lib<T>() || std::strcmp(T::name, name)) { return false; }
+    luaL_requiref(L, T::name, T::func, 0);
+    return true;
+  }
+
+  static bool load_lib(lua_State * L, const char * name) {
+    bool found = false;
+    int dummy[] = {(found = found || try_load_lib<Ts>(L, name), 0)..., 0};
+    static_cast<void>(dummy);
+    return found;
+  }
+
+  static int loader(lua_State * L) {
+    const char * name = lua_tostring(L, 1);
+    return (name && load_lib(L, name)) ? 1 : 0;
+  }
+
+  // Called by `require` with the name of a library in package.preload
+  static int preloader(lua_State * L) {
+    const char * name = luaL_checkstring(L, 1);
+    if (!load_lib(L, name)) {
+      return luaL_error(L, "no lazy library named '%s'", name);
+    }
+    return 1;
+  }
+
+  template <typename T>
+  static void persist_lib(lua_State * L) {
+    if (is_eager_lib<T>() || is_lib_loaded<T>(L)) {
+      base_t::template load_lib_into_table<T, false>(L);
+    }
+  }
+
+  template <typename T>
+  static void unpersist_lib(lua_State * L) {
+    if (is_eager_lib<T>() || is_lib_loaded<T>(L)) {
+      base_t::template load_lib_into_table<T, true>(L);
+    } else {
+      PRIMER_ASSERT_STACK_NEUTRAL(L);              // [target]
+      lua_pushcfunction(L, T::func);               // [target] [func]
+      lua_pushstring(L, T::name);                  // [target] [func] [name]
+      lua_call(L, 1, 1);                           // [target] [lib]
+      base_t::template lib_into_table<T, true>(L); // [target]
+    }
+  }
+
+  // Expects the new table and the loaded table on top of the stack
+  template <typename T>
+  static void save_loaded_lib(lua_State * L) {
+    if (!is_eager_lib<T>()) {
+      lua_getfield(L, -1, T::name); // [t] [loaded] [lib]
+      lua_setfield(L, -3, T::name); // [t] [loaded]
+    }
+  }
+
+  static constexpr const char * loader_name = "primer_lazy_libraries";
+  static constexpr const char * preloader_name =
+    "primer_lazy_libraries_preload";
+
+  static void perms(lua_State * L, bool kv_order) {
+    api::lazy_global_loader_perms(L, &lazy_libraries::loader, loader_name,
+                                  kv_order);
+    detail::lazy_globals_perm(L, &lazy_libraries::preloader, preloader_name,
+                              kv_order);
+  }
+
+public:
+  void on_init(lua_State * L) {
+    int dummy[] = {(load_eager_lib<Ts>(L), 0)..., 0};
+    static_cast<void>(dummy);
+    api::add_lazy_global_loader(L, &lazy_libraries::loader);
+
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    if (lua_getfield(L, -1, LUA_LOADLIBNAME) == LUA_TTABLE) {
+      luaL_getsubtable(L, -1, "preload");
+      int dummy2[] = {(preload_lib<Ts>(L), 0)..., 0};
+      static_cast<void>(dummy2);
+      lua_pop(L, 1);
+    }
+    lua_pop(L, 2);
+  }
+
+  void on_persist_table(lua_State * L) {
+    int dummy[] = {(persist_lib<Ts>(L), 0)..., 0};
+    static_cast<void>(dummy);
+    perms(L, false);
+  }
+
+  void on_unpersist_table(lua_State * L) {
+    int dummy[] = {(unpersist_lib<Ts>(L), 0)..., 0};
+    static_cast<void>(dummy);
+    perms(L, true);
+  }
+
+  // The libraries which were opened lazily, by name
+  void on_serialize(lua_State * L) {
+    lua_newtable(L);                                          // [t]
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE); // [t] [loaded]
+    int dummy[] = {(save_loaded_lib<Ts>(L), 0)..., 0};
+    static_cast<void>(dummy);
+    lua_pop(L, 1); // [t]
+  }
+
+  void on_deserialize(lua_State * L) {
+    if (!lua_istable(L, -1)) {
+      lua_pop(L, 1);
+      return;
+    }
+    // Register the restored library tables as loaded
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE); // [t] [loaded]
+    lua_pushnil(L);           // [t] [loaded] [nil]
+    while (lua_next(L, -3)) { // [t] [loaded] [k] [v]
+      lua_pushvalue(L, -2);   // [t] [loaded] [k] [v] [k]
+      lua_insert(L, -2);      // [t] [loaded] [k] [k] [v]
+      lua_settable(L, -4);    // [t] [loaded] [k]
+    }                         // [t] [loaded]
+    lua_pop(L, 2);
+  }
+};
+
 using basic_libraries = libraries<lua_base_lib_sandboxed, lua_table_lib,
                                   lua_math_lib, lua_string_lib>;
 
@@ -9,11 +9,11 @@
 
 PRIMER_ASSERT_FILESCOPE;
 
+#include <primer/api/upvalue_dispatch.hpp>
 #include <primer/cpp_pcall.hpp>
 #include <primer/error_capture.hpp>
 #include <primer/lua.hpp>
 #include <primer/registry_helper.hpp>
-#include <primer/set_funcs.hpp>
 #include <primer/support/asserts.hpp>
 #include <primer/support/scoped_stash_global_value.hpp>
 
@@ -195,7 +195,7 @@ class print_manager {
   }
 
   static int intf_print_impl(lua_State * L) {
-    print_manager * man = recover_self(L);
+    print_manager * man = detail::upvalue_self<print_manager>(L);
     if (man->print_format_) {
       man->new_text(man->print_format_(L));
     } else {
@@ -205,7 +205,7 @@ class print_manager {
   }
 
   static int intf_pretty_print_impl(lua_State * L) {
-    print_manager * man = recover_self(L);
+    print_manager * man = detail::upvalue_self<print_manager>(L);
     if (man->pretty_print_format_) {
       man->new_text(man->pretty_print_format_(L));
     } else {
@@ -300,16 +300,16 @@ public:
     registry_helper<print_manager>::store(L, this);
 
     lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
-    primer::set_funcs(L, get_funcs());
+    primer::set_bound_funcs(L, this, "print_manager__", get_funcs());
     lua_pop(L, 1);
   }
 
   void on_persist_table(lua_State * L) {
-    primer::set_funcs_prefix_reverse(L, "print_manager__", get_funcs());
+    primer::set_bound_funcs_prefix_reverse(L, "print_manager__", get_funcs());
   }
 
   void on_unpersist_table(lua_State * L) {
-    primer::set_funcs_prefix(L, "print_manager__", get_funcs());
+    primer::set_bound_funcs_prefix(L, "print_manager__", get_funcs());
   }
 };
 
@@ -328,7 +328,8 @@ api::print_manager::handle_interpreter_input(lua_State * L,
 
   // If the user messed with _pretty_print function, temporarily ours back.
   primer::detail::scoped_stash_global_value(L, pretty_print_name);
-  lua_pushcfunction(L, &intf_pretty_print_impl);
+  lua_pushlightuserdata(L, static_cast<void *>(this));
+  lua_pushcclosure(L, &intf_pretty_print_impl, 1);
   lua_setglobal(L, pretty_print_name);
 
   std::string experiment = pretty_print_name + ("(" + text + ")");
@@ -0,0 +1,486 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/api/upvalue_dispatch.hpp>
+#include <primer/bound_function.hpp>
+#include <primer/budget.hpp>
+#include <primer/cpp_pcall.hpp>
+#include <primer/error.hpp>
+#include <primer/error_capture.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/push.hpp>
+#include <primer/support/asserts.hpp>
+#include <primer/support/function.hpp>
+#include <primer/support/function_check_stack.hpp>
+#include <primer/support/thread_pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//[ primer_scheduler_overview
+//` The `scheduler` class is an API feature which owns a collection of lua
+//` coroutines, called "tasks", and resumes them cooperatively.
+//`
+//` A task tells the scheduler what it is waiting for by the values that it
+//` yields:
+//`
+//` * nothing, or `nil`: resume it again on the next tick
+//` * a number: sleep for that many seconds
+//` * a string: wait until the event of that name is signalled
+//`
+//` Anything else is an error, and the task is dropped.
+//`
+//` The feature also installs global functions `spawn`, `signal`, `sleep`,
+//` `wait` and `next_frame`, so that scripts don't have to yield explicitly.
+//`
+//` Each call to `tick` moves the tasks whose wait condition is satisfied to the
+//` ready queue, and resumes ready tasks until the queue is empty or the time
+//` budget is exhausted. The budget is checked after each batch of resumes,
+//` ready tasks which were not reached stay at the front of the queue for the
+//` next tick.
+//`
+//` A `primer::budget` can be set to preempt tasks which run for too long, so
+//` that a single task cannot starve the others.
+//`
+//` Errors raised by tasks are not propagated, they are collected and can be
+//` obtained with `pop_errors`.
+//]
+
+namespace primer {
+
+namespace api {
+
+//[ primer_scheduler_synopsis
+class scheduler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  //<-
+private:
+  // A task is a lua thread, kept alive by a reference in the registry
+  struct task {
+    lua_State * thread;
+    int ref;
+  };
+
+  struct sleeper {
+    clock::time_point wake;
+    task t;
+  };
+
+  // Makes `std::push_heap` etc. produce a min-heap on wake time
+  struct sleeper_compare {
+    bool operator()(const sleeper & a, const sleeper & b) const {
+      return a.wake > b.wake;
+    }
+  };
+
+  std::deque<task> ready_;
+  std::vector<task> next_frame_;
+  std::vector<sleeper> sleeping_;
+  std::unordered_map<std::string, std::vector<task>> events_;
+  std::vector<primer::error> errors_;
+
+  clock::time_point now_;
+  std::size_t batch_size_ = 32;
+  budget task_budget_;
+
+  // Set after deserialization, when the wake times of sleepers are relative to
+  // the epoch rather than to the current time.
+  bool rebase_sleepers_ = false;
+
+  static scheduler * recover_self(lua_State * L) {
+    return detail::upvalue_self<scheduler>(L);
+  }
+
+  // Release a task which won't be resumed again
+  static void finish(lua_State * L, const task & t) {
+    detail::recycle_thread(L, t.thread);
+    luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+  }
+
+  // Expects: Thread on top of the stack of L, with the function and arguments
+  // on its own stack. Pops the thread.
+  void add_task(lua_State * L) {
+    lua_State * T = lua_tothread(L, -1);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    ready_.push_back(task{T, ref});
+  }
+
+  // Put a task that just yielded into the right queue
+  inline void wait(lua_State * L, const task & t);
+
+  // Resume one task
+  inline void resume(lua_State * L, const task & t);
+
+  inline void tick_impl(lua_State * L, clock::duration frame_budget,
+                        std::size_t & count);
+
+  inline void clear(lua_State * L);
+
+  static int intf_spawn(lua_State * L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    const int n = lua_gettop(L);
+    lua_State * T = detail::acquire_thread(L);
+    if (!lua_checkstack(T, n)) {
+      return luaL_error(L, "spawn: insufficient stack space");
+    }
+    lua_insert(L, 1);
+    lua_xmove(L, T, n);
+    recover_self(L)->add_task(L);
+    return 0;
+  }
+
+  static int intf_signal(lua_State * L) {
+    recover_self(L)->signal(luaL_checkstring(L, 1));
+    return 0;
+  }
+
+  static int intf_sleep(lua_State * L) {
+    luaL_checknumber(L, 1);
+    lua_settop(L, 1);
+    return lua_yield(L, 1);
+  }
+
+  static int intf_wait(lua_State * L) {
+    luaL_checkstring(L, 1);
+    lua_settop(L, 1);
+    return lua_yield(L, 1);
+  }
+
+  static int intf_next_frame(lua_State * L) {
+    lua_settop(L, 0);
+    return lua_yield(L, 0);
+  }
+
+  // Helper
+  static std::array<const luaL_Reg, 5> get_funcs() {
+    std::array<const luaL_Reg, 5> funcs = {{
+      luaL_Reg{"spawn", &intf_spawn},
+      luaL_Reg{"signal", &intf_signal},
+      luaL_Reg{"sleep", &intf_sleep},
+      luaL_Reg{"wait", &intf_wait},
+      luaL_Reg{"next_frame", &intf_next_frame},
+    }};
+    return funcs;
+  }
+
+  //->
+public:
+  // Create a new task. It will first be resumed in the next `tick`.
+  template <typename... Args>
+  expected<void> spawn(const bound_function & f, Args &&... args) noexcept;
+
+  // Wake every task waiting on an event.
+  void signal(const std::string & event) {
+    auto it = events_.find(event);
+    if (it != events_.end()) {
+      ready_.insert(ready_.end(), it->second.begin(), it->second.end());
+      events_.erase(it);
+    }
+  }
+
+  // Run ready tasks, until the queue is empty or the budget is exhausted.
+  // `now` is the time used to wake up sleeping tasks.
+  // Returns the number of tasks that were resumed.
+  inline std::size_t tick(lua_State * L, clock::time_point now,
+                          clock::duration frame_budget) noexcept;
+
+  std::size_t tick(lua_State * L, clock::duration frame_budget) noexcept {
+    return this->tick(L, clock::now(), frame_budget);
+  }
+
+  // How many resumes happen between checks of the clock
+  void set_batch_size(std::size_t n) { batch_size_ = n ? n : 1; }
+
+  // Limit how long a task may run per resume. A task which exhausts it is
+  // preempted, and continues on the next tick.
+  void set_task_budget(const budget & b) { task_budget_ = b; }
+
+  // Number of tasks, total and ready to run
+  std::size_t size() const {
+    std::size_t result = ready_.size() + next_frame_.size() + sleeping_.size();
+    for (const auto & p : events_) {
+      result += p.second.size();
+    }
+    return result;
+  }
+
+  std::size_t ready_count() const { return ready_.size(); }
+
+  // Take the errors produced by tasks since the last call
+  std::vector<primer::error> pop_errors() {
+    std::vector<primer::error> result;
+    result.swap(errors_);
+    return result;
+  }
+
+  //
+  // API Feature
+  //
+
+  void on_init(lua_State * L) {
+    PRIMER_ASSERT_STACK_NEUTRAL(L);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+    primer::set_bound_funcs(L, this, "scheduler__", get_funcs());
+    lua_pop(L, 1);
+  }
+
+  void on_persist_table(lua_State * L) {
+    primer::set_bound_funcs_prefix_reverse(L, "scheduler__", get_funcs());
+  }
+
+  void on_unpersist_table(lua_State * L) {
+    primer::set_bound_funcs_prefix(L, "scheduler__", get_funcs());
+  }
+
+  // Tasks are saved as a sequence of pairs (thread, wait condition), where the
+  // condition is `false` for ready, `true` for next frame, remaining seconds
+  // for sleepers, and the event name for waiters.
+  // After restoring, sleep times count from the next `tick`.
+  inline void on_serialize(lua_State * L);
+  inline void on_deserialize(lua_State * L);
+};
+//]
+
+template <typename... Args>
+expected<void>
+scheduler::spawn(const bound_function & f, Args &&... args) noexcept {
+  expected<void> result;
+  if (lua_State * L = f.push()) {
+    auto ok = primer::mem_pcall<1>(L, [&]() {
+      lua_State * T = detail::acquire_thread(L);
+      lua_insert(L, -2);
+      if (auto check = detail::check_stack_push_each<Args...>(T)) {
+        lua_xmove(L, T, 1);
+        primer::push_each(T, std::forward<Args>(args)...);
+        this->add_task(L);
+      } else {
+        lua_pop(L, 2);
+        result = std::move(check.err());
+      }
+    });
+    if (!ok) { result = std::move(ok.err()); }
+  } else {
+    result = primer::error::cant_lock_vm();
+  }
+  return result;
+}
+
+inline void
+scheduler::wait(lua_State * L, const task & t) {
+  lua_State * T = t.thread;
+  switch (lua_gettop(T) ? lua_type(T, 1) : LUA_TNIL) {
+    case LUA_TNIL:
+      next_frame_.push_back(t);
+      return;
+    case LUA_TNUMBER: {
+      std::chrono::duration<double> secs{lua_tonumber(T, 1)};
+      if (secs.count() <= 0) {
+        next_frame_.push_back(t);
+      } else {
+        sleeping_.push_back(
+          sleeper{now_ + std::chrono::duration_cast<clock::duration>(secs), t});
+        std::push_heap(sleeping_.begin(), sleeping_.end(), sleeper_compare{});
+      }
+      return;
+    }
+    case LUA_TSTRING:
+      events_[lua_tostring(T, 1)].push_back(t);
+      return;
+    default:
+      errors_.emplace_back("scheduler: invalid wait condition of type '",
+                           luaL_typename(T, 1), "'");
+      finish(L, t);
+      return;
+  }
+}
+
+inline void
+scheduler::resume(lua_State * L, const task & t) {
+  lua_State * T = t.thread;
+
+  // A task which hasn't started has its function and arguments on the stack.
+  // A task which yielded has the wait condition on the stack.
+  int narg = 0;
+  if (lua_status(T) == LUA_YIELD) {
+    lua_settop(T, 0);
+  } else {
+    narg = lua_gettop(T) - 1;
+  }
+
+  int code;
+  {
+    detail::budget_scope scope{T, task_budget_};
+    code = std::get<0>(detail::resume_helper(T, narg));
+  }
+
+  // A preempted task yielded no values, so it continues on the next tick.
+  if (code == LUA_YIELD) {
+    this->wait(L, t);
+  } else {
+    if (code != LUA_OK) { errors_.emplace_back(primer::pop_error(T, code)); }
+    finish(L, t);
+  }
+}
+
+inline void
+scheduler::tick_impl(lua_State * L, clock::duration frame_budget,
+                     std::size_t & count) {
+  ready_.insert(ready_.end(), next_frame_.begin(), next_frame_.end());
+  next_frame_.clear();
+
+  while (sleeping_.size() && sleeping_.front().wake <= now_) {
+    std::pop_heap(sleeping_.begin(), sleeping_.end(), sleeper_compare{});
+    ready_.push_back(sleeping_.back().t);
+    sleeping_.pop_back();
+  }
+
+  const auto start = clock::now();
+  while (ready_.size()) {
+    if (count && !(count % batch_size_)
+        && clock::now() - start >= frame_budget) {
+      return;
+    }
+    task t = ready_.front();
+    ready_.pop_front();
+    this->resume(L, t);
+    ++count;
+  }
+}
+
+inline std::size_t
+scheduler::tick(lua_State * L, clock::time_point now,
+                clock::duration frame_budget) noexcept {
+  now_ = now;
+  if (rebase_sleepers_) {
+    for (sleeper & s : sleeping_) {
+      s.wake += now_.time_since_epoch();
+    }
+    rebase_sleepers_ = false;
+  }
+  std::size_t count = 0;
+  auto ok =
+    primer::mem_pcall(L, [&]() { this->tick_impl(L, frame_budget, count); });
+  if (!ok) { errors_.emplace_back(std::move(ok.err())); }
+  return count;
+}
+
+inline void
+scheduler::clear(lua_State * L) {
+  for (const task & t : ready_) {
+    luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+  }
+  for (const task & t : next_frame_) {
+    luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+  }
+  for (const sleeper & s : sleeping_) {
+    luaL_unref(L, LUA_REGISTRYINDEX, s.t.ref);
+  }
+  for (const auto & p : events_) {
+    for (const task & t : p.second) {
+      luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+    }
+  }
+  ready_.clear();
+  next_frame_.clear();
+  sleeping_.clear();
+  events_.clear();
+  rebase_sleepers_ = false;
+}
+
+inline void
+scheduler::on_serialize(lua_State * L) {
+  lua_createtable(L, 2 * static_cast<int>(this->size()), 0);
+  lua_Integer idx = 0;
+
+  auto push_task = [&](const task & t) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, t.ref);
+    lua_rawseti(L, -3, ++idx);
+    lua_rawseti(L, -2, ++idx);
+  };
+
+  for (const task & t : ready_) {
+    lua_pushboolean(L, false);
+    push_task(t);
+  }
+  for (const task & t : next_frame_) {
+    lua_pushboolean(L, true);
+    push_task(t);
+  }
+  for (const sleeper & s : sleeping_) {
+    lua_pushnumber(L, std::chrono::duration<double>(s.wake - now_).count());
+    push_task(s.t);
+  }
+  for (const auto & p : events_) {
+    for (const task & t : p.second) {
+      lua_pushlstring(L, p.first.c_str(), p.first.size());
+      push_task(t);
+    }
+  }
+}
+
+inline void
+scheduler::on_deserialize(lua_State * L) {
+  this->clear(L);
+
+  if (lua_istable(L, -1)) {
+    const lua_Integer n = static_cast<lua_Integer>(lua_rawlen(L, -1));
+    for (lua_Integer idx = 1; idx + 1 <= n; idx += 2) {
+      lua_rawgeti(L, -1, idx);
+      if (!lua_isthread(L, -1)) {
+        lua_pop(L, 1);
+        continue;
+      }
+      lua_State * T = lua_tothread(L, -1);
+      task t{T, luaL_ref(L, LUA_REGISTRYINDEX)};
+
+      lua_rawgeti(L, -1, idx + 1);
+      switch (lua_type(L, -1)) {
+        case LUA_TBOOLEAN:
+          if (lua_toboolean(L, -1)) {
+            next_frame_.push_back(t);
+          } else {
+            ready_.push_back(t);
+          }
+          break;
+        case LUA_TNUMBER: {
+          std::chrono::duration<double> secs{lua_tonumber(L, -1)};
+          auto wake = std::chrono::duration_cast<clock::duration>(secs);
+          sleeping_.push_back(sleeper{clock::time_point{wake}, t});
+          std::push_heap(sleeping_.begin(), sleeping_.end(), sleeper_compare{});
+          rebase_sleepers_ = true;
+          break;
+        }
+        case LUA_TSTRING:
+          events_[lua_tostring(L, -1)].push_back(t);
+          break;
+        default:
+          luaL_unref(L, LUA_REGISTRYINDEX, t.ref);
+          break;
+      }
+      lua_pop(L, 1);
+    }
+  }
+  lua_pop(L, 1);
+}
+
+} // end namespace api
+
+} // end namespace primer
@@ -0,0 +1,181 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Facilities to dispatch calls to an object using a pointer to that object
+ * stored as the first upvalue of a C closure.
+ *
+ * Unlike the extraspace, any number of objects in one lua_State can use this,
+ * and unlike `registry_helper`, recovering the pointer does not access the
+ * registry.
+ *
+ * Eris would persist the pointer as a raw address, so the closures themselves
+ * must be permanent objects. `set_bound_funcs` also records the closures in
+ * the registry, under the given prefix, and `set_bound_funcs_prefix_reverse`
+ * and `set_bound_funcs_prefix` fill the (un)persist tables from that record.
+ * When unpersisting, the closures of the receiving object are substituted.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/detail/luaL_Reg.hpp>
+#include <primer/lua.hpp>
+#include <primer/result.hpp>
+#include <primer/support/asserts.hpp>
+
+#include <string>
+#include <utility>
+
+namespace primer {
+
+namespace detail {
+
+// Recover the object pointer in a closure created by `set_bound_funcs`
+template <typename T>
+T *
+upvalue_self(lua_State * L) {
+  void * vptr = lua_touserdata(L, lua_upvalueindex(1));
+  PRIMER_ASSERT(vptr, "Upvalue pointer was not initialized!");
+  return static_cast<T *>(vptr);
+}
+
+// The address of this function is the registry key of the bound closures
+inline int
+bound_funcs_key(lua_State *) {
+  return 0;
+}
+
+// Push the registry table holding the bound closures, creating it if needed
+inline void
+push_bound_funcs_table(lua_State * L) {
+  lua_pushcfunction(L, &bound_funcs_key);
+  if (lua_rawget(L, LUA_REGISTRYINDEX) != LUA_TTABLE) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushcfunction(L, &bound_funcs_key);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+  }
+}
+
+} // end namespace detail
+
+namespace api {
+
+/***
+ * Dispatcher primary template, falls back to the basic adaptor.
+ */
+
+template <typename T, typename F, F f>
+struct upvalue_dispatcher : public adapt<F, f> {};
+
+/***
+ * Specialize for a member function
+ */
+
+template <typename T, typename R, typename... Args,
+          R (T::*target_func)(lua_State *, Args...)>
+struct upvalue_dispatcher<T, R (T::*)(lua_State *, Args...), target_func> {
+
+  static R dispatch_target(lua_State * L, Args... args) {
+    T * object_ptr = detail::upvalue_self<T>(L);
+    return (object_ptr->*target_func)(L, std::forward<Args>(args)...);
+  }
+
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    using helper_t = adapt<R (*)(lua_State *, Args...), dispatch_target>;
+    return helper_t::adapted_result(L);
+  }
+
+  static int adapted(lua_State * L) {
+    using helper_t = adapt<R (*)(lua_State *, Args...), dispatch_target>;
+    return helper_t::adapted(L);
+  }
+};
+
+#define PRIMER_ADAPT_UPVALUE(t, f)                                             \
+  &primer::api::upvalue_dispatcher<t, decltype(f), f>::adapted
+
+} // end namespace api
+
+/***
+ * Register a sequence of luaL_Reg-like objects with the table on top of the
+ * stack, as closures with `self` as their upvalue. Similar to `set_funcs`.
+ */
+template <typename T>
+void
+set_bound_funcs(lua_State * L, void * self, const std::string & prefix,
+                T && seq) {
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  PRIMER_ASSERT_TABLE(L);
+
+  detail::push_bound_funcs_table(L); // [t] [bound]
+  detail::iterate_L_Reg_sequence(
+    std::forward<T>(seq), [&](const char * name, lua_CFunction func) {
+      if (name && func) {
+        lua_pushlightuserdata(L, self);
+        lua_pushcclosure(L, func, 1); // [t] [bound] [f]
+        lua_pushvalue(L, -1);
+        lua_setfield(L, -3, (prefix + name).c_str());
+        lua_setfield(L, -3, name);
+      }
+    });
+  lua_pop(L, 1);
+}
+
+/***
+ * Register the closures made by `set_bound_funcs` in the persist table
+ * (closure as key) or in the unpersist table (closure as value).
+ */
+template <typename T>
+void
+set_bound_funcs_prefix_reverse(lua_State * L, const std::string & prefix,
+                               T && seq) {
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  PRIMER_ASSERT_TABLE(L);
+
+  detail::push_bound_funcs_table(L); // [perms] [bound]
+  detail::iterate_L_Reg_sequence(
+    std::forward<T>(seq), [&](const char * name, lua_CFunction func) {
+      if (name && func) {
+        std::string key = prefix + name;
+        if (lua_getfield(L, -1, key.c_str()) == LUA_TFUNCTION) {
+          lua_pushstring(L, key.c_str()); // [perms] [bound] [f] [key]
+          lua_settable(L, -4);
+        } else {
+          lua_pop(L, 1);
+        }
+      }
+    });
+  lua_pop(L, 1);
+}
+
+template <typename T>
+void
+set_bound_funcs_prefix(lua_State * L, const std::string & prefix, T && seq) {
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  PRIMER_ASSERT_TABLE(L);
+
+  detail::push_bound_funcs_table(L); // [perms] [bound]
+  detail::iterate_L_Reg_sequence(
+    std::forward<T>(seq), [&](const char * name, lua_CFunction func) {
+      if (name && func) {
+        std::string key = prefix + name;
+        if (lua_getfield(L, -1, key.c_str()) == LUA_TFUNCTION) {
+          lua_setfield(L, -3, key.c_str());
+        } else {
+          lua_pop(L, 1);
+        }
+      }
+    });
+  lua_pop(L, 1);
+}
+
+} // end namespace primer
@@ -12,10 +12,9 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/lua.hpp>
 
 #include <primer/adapt.hpp>
+#include <primer/api/upvalue_dispatch.hpp>
 #include <primer/cpp_pcall.hpp>
 #include <primer/error_capture.hpp>
-#include <primer/registry_helper.hpp>
-#include <primer/set_funcs.hpp>
 #include <primer/support/asserts.hpp>
 #include <primer/support/function.hpp>
 
@@ -55,9 +54,7 @@ template <typename T>
 class vfs {
 
   static T * recover_this(lua_State * L) {
-    vfs * ptr = registry_helper<vfs>::obtain(L);
-    PRIMER_ASSERT(ptr, "Could not recover self pointer!");
-    return static_cast<T *>(ptr);
+    return static_cast<T *>(detail::upvalue_self<vfs>(L));
   }
 
 protected:
@@ -121,21 +118,17 @@ public:
   // API Feature
 
   void on_init(lua_State * L) {
-    registry_helper<vfs>::store(L, this);
-
-    PRIMER_ASSERT(recover_this(L) == static_cast<T *>(this), "bad self store");
-
     lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
-    primer::set_funcs(L, vfs::get_funcs());
+    primer::set_bound_funcs(L, this, "vfs_funcs_", vfs::get_funcs());
     lua_pop(L, 1);
   }
 
   void on_persist_table(lua_State * L) {
-    primer::set_funcs_prefix_reverse(L, "vfs_funcs_", vfs::get_funcs());
+    primer::set_bound_funcs_prefix_reverse(L, "vfs_funcs_", vfs::get_funcs());
   }
 
   void on_unpersist_table(lua_State * L) {
-    primer::set_funcs_prefix(L, "vfs_funcs_", vfs::get_funcs());
+    primer::set_bound_funcs_prefix(L, "vfs_funcs_", vfs::get_funcs());
   }
 };
 
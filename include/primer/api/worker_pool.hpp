@@ -0,0 +1,348 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_api_worker_pool_docu
+
+/*`
+`api::worker_pool<VM>` runs stateless script work on several VMs in parallel.
+
+It starts a number of worker threads, and each of them default-constructs its
+own `VM` object, typically a class derived from `api::base`. Since they all
+run the same constructor, the VMs are initialized identically.
+
+Jobs name a global lua function, and give C++ arguments for it. Every job has
+a home worker, chosen by an explicit shard key or else by hashing the function
+name, so that jobs of the same kind go to the same VM. Each worker has its own
+deque of jobs, and idle workers steal from the others, so that the load is
+balanced even when the keys are not.
+
+Results are read into C++ values on the worker thread and delivered through a
+`std::future`, like `primer::executor`.
+
+The constructor waits until every worker has constructed its VM. If a `VM`
+constructor throws, the pool stops the other workers and the constructor
+rethrows the exception.
+
+Since any job may run on any VM, scripts should not keep state between jobs.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/bound_function.hpp>
+#include <primer/cpp_pcall.hpp>
+#include <primer/detail/count.hpp>
+#include <primer/error.hpp>
+#include <primer/executor.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace primer {
+
+namespace detail {
+
+// Pin the calling thread to one core. Best effort, does nothing on
+// unsupported platforms.
+inline void
+pin_this_thread_to_core(unsigned core) noexcept {
+#if defined(__linux__)
+  unsigned n = std::thread::hardware_concurrency();
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(n ? core % n : core, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  static_cast<void>(core);
+#endif
+}
+
+} // end namespace detail
+
+namespace api {
+
+//[ primer_api_worker_pool
+template <typename VM>
+class worker_pool {
+public:
+  /*<< Gets the lua state of a VM object >>*/
+  using state_fn = lua_State * (*)(VM &);
+
+  //<-
+private:
+  // A queued job. `exec` runs the job on a VM and destroys it.
+  struct job {
+    void (*exec)(job *, lua_State *);
+  };
+
+  template <typename T, typename... Args>
+  struct job_impl : job {
+    std::string name;
+    std::tuple<Args...> args;
+    std::promise<expected<T>> promise;
+
+    template <std::size_t... Is>
+    expected<T> invoke(const bound_function & f, detail::SizeList<Is...>) {
+      return detail::executor_invoke<T>::call(f,
+                                              std::move(std::get<Is>(args))...);
+    }
+
+    static void exec_impl(job * b, lua_State * L) {
+      std::unique_ptr<job_impl> j{static_cast<job_impl *>(b)};
+      expected<T> result{primer::error::insufficient_stack_space(1)};
+      if (lua_checkstack(L, 1)) {
+        bound_function f;
+        auto ok = mem_pcall(L, [&]() {
+          lua_getglobal(L, j->name.c_str());
+          f = bound_function{L};
+        });
+        if (!ok) {
+          result = std::move(ok.err());
+        } else if (!f) {
+          result = primer::error{"worker_pool: no function named '", j->name,
+                                 "'"};
+        } else {
+          result = j->invoke(f, detail::Count_t<sizeof...(Args)>{});
+        }
+      }
+      j->promise.set_value(std::move(result));
+    }
+  };
+
+  struct worker {
+    std::mutex mutex;
+    std::deque<job *> jobs;
+    std::thread thread;
+  };
+
+  state_fn get_state_;
+  std::vector<std::unique_ptr<worker>> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<std::size_t> pending_;
+  bool stop_;
+  // Guarded by mutex_, number of workers still constructing their VM, and the
+  // first exception thrown by a VM constructor
+  std::size_t starting_;
+  std::exception_ptr start_error_;
+
+  // Take a job from the front of our own deque, or steal one from the back of
+  // another worker's deque.
+  job * take(std::size_t idx) {
+    const std::size_t n = workers_.size();
+    for (std::size_t k = 0; k < n; ++k) {
+      worker & w = *workers_[(idx + k) % n];
+      std::lock_guard<std::mutex> lock{w.mutex};
+      if (!w.jobs.empty()) {
+        job * j;
+        if (k == 0) {
+          j = w.jobs.front();
+          w.jobs.pop_front();
+        } else {
+          j = w.jobs.back();
+          w.jobs.pop_back();
+        }
+        --pending_;
+        return j;
+      }
+    }
+    return nullptr;
+  }
+
+  // Pin the thread first, so that the VM is allocated on the right core. Then
+  // report to the constructor of the pool. Returns null if the VM constructor
+  // threw.
+  std::unique_ptr<VM> start(std::size_t idx, bool pin) {
+    if (pin) { detail::pin_this_thread_to_core(static_cast<unsigned>(idx)); }
+
+    std::unique_ptr<VM> vm;
+    std::exception_ptr error;
+    PRIMER_TRY { vm.reset(new VM); }
+    PRIMER_CATCH(...) { error = std::current_exception(); }
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (error && !start_error_) { start_error_ = error; }
+    --starting_;
+    cv_.notify_all();
+    return vm;
+  }
+
+  void run(std::size_t idx, bool pin) {
+    std::unique_ptr<VM> vm = this->start(idx, pin);
+    if (!vm) { return; }
+    lua_State * L = get_state_(*vm);
+    for (;;) {
+      if (job * j = this->take(idx)) {
+        j->exec(j, L);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock{mutex_};
+      cv_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+      if (stop_ && pending_ == 0) { return; }
+    }
+  }
+
+  // pending_ is incremented under the lock of the deque, as take decrements
+  // it, so that it never counts fewer jobs than the deques hold.
+  template <typename J>
+  void push(std::size_t key, std::unique_ptr<J> & j) {
+    worker & w = *workers_[key % workers_.size()];
+    {
+      std::lock_guard<std::mutex> lock{w.mutex};
+      ++pending_;
+      PRIMER_TRY { w.jobs.push_back(j.get()); }
+      PRIMER_CATCH(...) {
+        --pending_;
+        PRIMER_RETHROW;
+      }
+      j.release();
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    cv_.notify_one();
+  }
+
+  // Stop the workers which were started, after they finish the posted jobs
+  void stop() noexcept {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto & w : workers_) {
+      if (w->thread.joinable()) { w->thread.join(); }
+    }
+  }
+
+  //->
+public:
+  /*<< Starts `num_workers` threads, or one per core if it is zero. Each thread
+       constructs a `VM`. Optionally, the threads are pinned to cores. Throws
+       what a `VM` constructor throws. >>*/
+  explicit worker_pool(state_fn get_state, std::size_t num_workers = 0,
+                       bool pin_to_cores = false);
+
+  /*<< Waits until all posted jobs have run, and stops the threads >>*/
+  ~worker_pool() noexcept;
+
+  worker_pool(const worker_pool &) = delete;
+  worker_pool & operator=(const worker_pool &) = delete;
+
+  /*<< Post a job. Thread-safe, throws `std::bad_alloc`. >>*/
+  template <typename T = void, typename... Args>
+  std::future<expected<T>> post(std::string name, Args &&... args);
+
+  /*<< Post a job to the worker chosen by a shard key >>*/
+  template <typename T = void, typename... Args>
+  std::future<expected<T>> post_shard(std::size_t shard, std::string name,
+                                      Args &&... args);
+
+  std::size_t size() const noexcept { return workers_.size(); }
+};
+//]
+
+template <typename VM>
+worker_pool<VM>::worker_pool(state_fn get_state, std::size_t num_workers,
+                             bool pin_to_cores)
+  : get_state_(get_state)
+  , workers_()
+  , mutex_()
+  , cv_()
+  , pending_(0)
+  , stop_(false)
+  , starting_(0)
+  , start_error_() {
+  if (!num_workers) { num_workers = std::thread::hardware_concurrency(); }
+  if (!num_workers) { num_workers = 1; }
+
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(new worker);
+  }
+
+  starting_ = num_workers;
+  for (std::size_t i = 0; i < num_workers; ++i) {
+    PRIMER_TRY {
+      workers_[i]->thread =
+        std::thread{&worker_pool::run, this, i, pin_to_cores};
+    }
+    PRIMER_CATCH(...) {
+      this->stop();
+      PRIMER_RETHROW;
+    }
+  }
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    cv_.wait(lock, [this]() { return !starting_; });
+    error = start_error_;
+  }
+  if (error) {
+    this->stop();
+    std::rethrow_exception(error);
+  }
+}
+
+template <typename VM>
+worker_pool<VM>::~worker_pool() noexcept {
+  this->stop();
+}
+
+template <typename VM>
+template <typename T, typename... Args>
+std::future<expected<T>>
+worker_pool<VM>::post_shard(std::size_t shard, std::string name,
+                            Args &&... args) {
+  static_assert(!std::is_same<T, lua_ref>::value
+                  && !std::is_same<T, lua_ref_seq>::value,
+                "lua references cannot be passed to other threads");
+  using job_t = job_impl<T, typename std::decay<Args>::type...>;
+
+  std::unique_ptr<job_t> j{new job_t};
+  j->exec = &job_t::exec_impl;
+  j->name = std::move(name);
+  j->args = std::make_tuple(std::forward<Args>(args)...);
+  std::future<expected<T>> result = j->promise.get_future();
+  this->push(shard, j);
+  return result;
+}
+
+template <typename VM>
+template <typename T, typename... Args>
+std::future<expected<T>>
+worker_pool<VM>::post(std::string name, Args &&... args) {
+  std::size_t shard = std::hash<std::string>{}(name);
+  return this->post_shard<T>(shard, std::move(name),
+                             std::forward<Args>(args)...);
+}
+
+} // end namespace api
+
+} // end namespace primer
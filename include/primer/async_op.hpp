@@ -0,0 +1,174 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_async_op_docu
+
+/*`
+`primer::async_op` represents a C++ operation which completes later, and which
+a lua script can wait for.
+
+It is a shared handle: copies refer to the same operation. It can be pushed
+to lua, where it is an opaque userdata. A script waits for it by yielding it
+as the only value, e.g. `coroutine.yield(op)`, or a C++ callback can push it
+and return `primer::yield{1}`.
+
+Whoever resumes the coroutine (see `<primer/await.hpp>`) recognizes the
+operation, and when it is completed, resumes the script with its results.
+If the operation fails, the script receives `nil` and the error message.
+
+An operation has at most one waiter. If a second script yields it while the
+first is still waiting, the second one gets an error instead of waiting.
+
+`complete` and `fail` should be called on the thread which runs the VM.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/error.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/lua_ref_seq.hpp>
+#include <primer/push_singleton.hpp>
+#include <primer/support/asserts.hpp>
+#include <primer/traits/push.hpp>
+
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace primer {
+
+//[ primer_async_op
+class async_op {
+public:
+  using callback_t = void (*)(void *);
+
+  //<-
+private:
+  struct state {
+    expected<lua_ref_seq> result;
+    bool ready;
+    callback_t callback;
+    void * callback_ctx;
+  };
+
+  std::shared_ptr<state> state_;
+
+  void finish() {
+    state_->ready = true;
+    if (callback_t cb = state_->callback) {
+      void * ctx = state_->callback_ctx;
+      state_->callback = nullptr;
+      state_->callback_ctx = nullptr;
+      cb(ctx);
+    }
+  }
+
+  static int gc(lua_State * L) {
+    static_cast<async_op *>(lua_touserdata(L, 1))->~async_op();
+    lua_pushnil(L);
+    lua_setmetatable(L, 1);
+    return 0;
+  }
+
+  static void push_metatable(lua_State * L) {
+    lua_newtable(L);
+    lua_pushcfunction(L, &async_op::gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushliteral(L, "async_op");
+    lua_setfield(L, -2, "__metatable");
+  }
+
+  //->
+public:
+  /*<< Throws `std::bad_alloc` >>*/
+  async_op()
+    : state_(std::make_shared<state>(state{lua_ref_seq{}, false, nullptr,
+                                           nullptr})) {}
+
+  bool ready() const noexcept { return state_->ready; }
+
+  /*<< Complete the operation, the values are returned to the script >>*/
+  void complete(lua_ref_seq values) {
+    state_->result = std::move(values);
+    this->finish();
+  }
+
+  /*<< Fail the operation >>*/
+  void fail(primer::error e) {
+    state_->result = std::move(e);
+    this->finish();
+  }
+
+  /*<< The results, once the operation is ready >>*/
+  const expected<lua_ref_seq> & result() const noexcept {
+    return state_->result;
+  }
+
+  /*<< Register a function to be called once, when the operation completes.
+       Only one waiter is supported: returns false, and registers nothing, if a
+       function with a different `ctx` is already registered. >>*/
+  bool on_complete(callback_t cb, void * ctx) noexcept {
+    if (state_->callback && state_->callback_ctx != ctx) { return false; }
+    state_->callback = cb;
+    state_->callback_ctx = ctx;
+    return true;
+  }
+
+  /*<< Unregister the function registered with `ctx`, if it is the waiter >>*/
+  void cancel(void * ctx) noexcept {
+    if (state_->callback_ctx == ctx) {
+      state_->callback = nullptr;
+      state_->callback_ctx = nullptr;
+    }
+  }
+
+  /*<< Push the operation to lua. Can cause lua memory allocation failure >>*/
+  void push(lua_State * L) const;
+
+  /*<< Check if a stack entry is an async_op, and get a pointer to it.
+       Can cause lua memory allocation failure >>*/
+  static async_op * test(lua_State * L, int idx);
+};
+//]
+
+inline void
+async_op::push(lua_State * L) const {
+  new (lua_newuserdata(L, sizeof(async_op))) async_op(*this);
+  push_singleton<&async_op::push_metatable>(L);
+  lua_setmetatable(L, -2);
+}
+
+inline async_op *
+async_op::test(lua_State * L, int idx) {
+  idx = lua_absindex(L, idx);
+  async_op * result = nullptr;
+  if (lua_isuserdata(L, idx) && lua_getmetatable(L, idx)) {
+    push_singleton<&async_op::push_metatable>(L);
+    if (lua_rawequal(L, -1, -2)) {
+      result = static_cast<async_op *>(lua_touserdata(L, idx));
+    }
+    lua_pop(L, 2);
+  }
+  return result;
+}
+
+namespace traits {
+
+template <>
+struct push<async_op> {
+  static void to_stack(lua_State * L, const async_op & op) { op.push(L); }
+  static constexpr int stack_space_needed{1};
+};
+
+} // end namespace traits
+
+} // end namespace primer
@@ -0,0 +1,217 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_await_docu
+
+/*`
+Awaitable wrappers over `primer::coroutine` and `primer::bound_function`, for
+use in C++20 coroutines.
+
+`co_await primer::step(c, args...)` resumes the coroutine `c` and produces the
+values that it yields or returns, as a `primer::step_result`.
+
+`co_await primer::async_call(f, args...)` runs the function `f` in a new
+coroutine, and produces the values that it returns.
+
+In both cases, if the script yields a `primer::async_op` which is not ready,
+the C++ coroutine is suspended. When the operation completes, the script is
+resumed with its results, and this continues until the script yields something
+else or returns. Only then is the C++ coroutine resumed.
+
+This header requires C++20, it is not included by `<primer/primer.hpp>`.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#if !defined(__cpp_impl_coroutine)
+#error "<primer/await.hpp> requires compiler support for C++20 coroutines"
+#endif
+
+#include <primer/async_op.hpp>
+#include <primer/bound_function.hpp>
+#include <primer/coroutine.hpp>
+#include <primer/error.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/lua_ref_seq.hpp>
+
+#include <coroutine>
+#include <utility>
+
+namespace primer {
+
+//[ primer_step_result
+struct step_result {
+  /*<< The values yielded or returned by the script >>*/
+  lua_ref_seq values;
+  /*<< True if the script returned, false if it yielded >>*/
+  bool done;
+};
+//]
+
+namespace detail {
+
+// Resumes a coroutine until it yields something other than a pending
+// `async_op`, and then resumes the awaiting C++ coroutine.
+class step_driver {
+  coroutine * co_;
+  expected<lua_ref_seq> last_;
+  async_op pending_;
+  std::coroutine_handle<> handle_;
+
+  // Check if the last resume yielded a single async_op
+  bool yielded_op() {
+    if (last_ && *co_ && !co_->preempted() && last_->size() == 1) {
+      lua_State * L = co_->lock();
+      if (L && lua_checkstack(L, 3)) {
+        bool found = false;
+        auto ok = primer::mem_pcall(L, [&]() {
+          last_->at(0).push(L);
+          if (async_op * op = async_op::test(L, -1)) {
+            pending_ = *op;
+            found = true;
+          }
+          lua_pop(L, 1);
+        });
+        return ok && found;
+      }
+    }
+    return false;
+  }
+
+  // Arguments for resuming the script after `pending_` completed
+  expected<lua_ref_seq> op_results() {
+    const expected<lua_ref_seq> & r = pending_.result();
+    if (r) { return *r; }
+
+    expected<lua_ref_seq> result{primer::error::cant_lock_vm()};
+    if (lua_State * L = co_->lock()) {
+      if (lua_checkstack(L, 2)) {
+        auto ok = primer::mem_pcall(L, [&]() {
+          lua_pushnil(L);
+          lua_pushstring(L, r.err().what());
+          result = primer::pop_n(L, 2);
+        });
+        if (!ok) { result = std::move(ok.err()); }
+      } else {
+        result = primer::error::insufficient_stack_space(2);
+      }
+    }
+    return result;
+  }
+
+  // Returns true when done, false when waiting on `pending_`.
+  bool advance() {
+    while (this->yielded_op()) {
+      if (!pending_.ready()) { return false; }
+      auto args = this->op_results();
+      if (!args) {
+        last_ = std::move(args.err());
+        return true;
+      }
+      last_ = co_->call(*args);
+    }
+    return true;
+  }
+
+  // Wait for `pending_`. Returns false, with an error in `last_`, if
+  // something else is waiting for it already.
+  bool wait() {
+    if (pending_.on_complete(&on_op_complete, this)) { return true; }
+    last_ = primer::error{"async_op is already awaited"};
+    return false;
+  }
+
+  static void on_op_complete(void * ctx) {
+    step_driver * self = static_cast<step_driver *>(ctx);
+    if (self->advance() || !self->wait()) { self->handle_.resume(); }
+  }
+
+public:
+  step_driver(coroutine & c, expected<lua_ref_seq> first)
+    : co_(&c)
+    , last_(std::move(first))
+    , pending_()
+    , handle_() {}
+
+  // If the awaiting coroutine is destroyed while suspended, the operation
+  // must not call back into it. Another waiter is left alone.
+  ~step_driver() { pending_.cancel(this); }
+
+  step_driver(const step_driver &) = delete;
+  step_driver & operator=(const step_driver &) = delete;
+
+  bool await_ready() { return this->advance(); }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    handle_ = h;
+    return this->wait();
+  }
+
+  expected<lua_ref_seq> & last() { return last_; }
+  coroutine & co() { return *co_; }
+};
+
+} // end namespace detail
+
+//[ primer_step_awaiter
+class step_awaiter : public detail::step_driver {
+public:
+  using detail::step_driver::step_driver;
+
+  expected<step_result> await_resume() {
+    if (!this->last()) { return std::move(this->last().err()); }
+    return step_result{std::move(*this->last()), !this->co()};
+  }
+};
+//]
+
+/*<< Resume a coroutine, passing it arguments. The first resume happens
+     immediately. >>*/
+template <typename... Args>
+step_awaiter
+step(coroutine & c, Args &&... args) {
+  return step_awaiter{c, c.call(std::forward<Args>(args)...)};
+}
+
+//[ primer_async_call_awaiter
+class async_call_awaiter {
+  coroutine co_;
+  detail::step_driver driver_;
+
+public:
+  template <typename... Args>
+  explicit async_call_awaiter(const bound_function & f, Args &&... args)
+    : co_(f)
+    , driver_(co_, co_.call(std::forward<Args>(args)...)) {}
+
+  bool await_ready() { return driver_.await_ready(); }
+  bool await_suspend(std::coroutine_handle<> h) {
+    return driver_.await_suspend(h);
+  }
+
+  expected<lua_ref_seq> await_resume() {
+    if (driver_.last() && co_) {
+      return primer::error("async_call: function yielded without an async_op");
+    }
+    return std::move(driver_.last());
+  }
+};
+//]
+
+/*<< Call a function in a new coroutine. It starts immediately. >>*/
+template <typename... Args>
+async_call_awaiter
+async_call(const bound_function & f, Args &&... args) {
+  return async_call_awaiter{f, std::forward<Args>(args)...};
+}
+
+} // end namespace primer
@@ -21,6 +21,7 @@
 
 PRIMER_ASSERT_FILESCOPE;
 
+#include <primer/call_stats.hpp>
 #include <primer/cpp_pcall.hpp>
 #include <primer/error.hpp>
 #include <primer/error_capture.hpp>
@@ -30,6 +31,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/lua_ref_seq.hpp>
 #include <primer/push.hpp>
 #include <primer/read.hpp>
+#include <primer/support/describe_function.hpp>
 #include <primer/support/function.hpp>
 #include <primer/support/function_check_stack.hpp>
 #include <primer/support/function_return.hpp>
@@ -57,8 +59,10 @@ class bound_function {
 //      auto ok = mem_pcall(L, [this, L, &result, &args...]() {
         auto ok = mem_pcall(L, [&]() {
           ref_.push(L);
+          detail::call_timer timer{detail::call_stats_lookup(L, -1)};
           primer::push_each(L, std::forward<Args>(args)...);
           detail::fcn_call(result, L, sizeof...(args));
+          timer.stop(static_cast<bool>(result));
         });
 
         if (!ok) { result = std::move(ok.err()); }
@@ -79,8 +83,10 @@ class bound_function {
       if (auto stack_check = detail::check_stack_push_n(L, 1 + inputs.size())) {
         auto ok = primer::mem_pcall(L, [this, &result, L, &inputs]() {
           ref_.push(L);
+          detail::call_timer timer{detail::call_stats_lookup(L, -1)};
           inputs.push_each(L);
           detail::fcn_call(result, L, inputs.size());
+          timer.stop(static_cast<bool>(result));
         });
         if (!ok) { result = std::move(ok.err()); }
       } else {
@@ -160,22 +166,7 @@ bound_function::debug_string() const {
   if (lua_State * L = ref_.lock()) {
     int top = lua_gettop(L);
     ref_.push();
-    if (lua_isfunction(L, -1)) {
-      result = "function ";
-      lua_Debug ar;
-      if (lua_getinfo(L, ">nS", &ar)) {
-        result = "";
-        if (*ar.namewhat) { result = ar.namewhat + (" " + result); }
-        if (ar.name) { result += ar.name; }
-        result += " [";
-        result += ar.short_src;
-        result += ":";
-        result += std::to_string(ar.linedefined);
-        result += "]";
-      } else {
-        result += "(unknown)";
-      }
-    }
+    if (lua_isfunction(L, -1)) { result = detail::describe_function(L); }
     lua_settop(L, top);
   }
 
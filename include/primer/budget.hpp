@@ -0,0 +1,163 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * A budget limits how long a coroutine may run before it is preempted.
+ *
+ * It is enforced by a count hook installed on the thread for the duration of
+ * a resume. When the budget is exhausted, the hook removes itself and yields
+ * back to C++. Resuming the thread continues execution where it stopped.
+ *
+ * A hook which was already set on the thread is restored afterwards. While the
+ * budget is active, it still receives its call, return and line events, but
+ * not its count events.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+
+#include <chrono>
+
+namespace primer {
+
+//[ primer_budget
+struct budget {
+  using clock = std::chrono::steady_clock;
+
+  /*<< Maximum number of VM instructions per resume. Zero means no limit. >>*/
+  long instructions = 0;
+  /*<< Maximum time per resume. Zero means no limit. >>*/
+  clock::duration time = clock::duration::zero();
+  /*<< Number of VM instructions between two checks of the budget. >>*/
+  int check_interval = 1000;
+
+  /*<< Check if any limit is set >>*/
+  explicit operator bool() const noexcept {
+    return instructions > 0 || time > clock::duration::zero();
+  }
+};
+//]
+
+namespace detail {
+
+struct budget_state {
+  lua_State * thread;
+  long instructions_left;
+  int interval;
+  budget::clock::time_point deadline;
+  bool has_deadline;
+  bool preempted;
+  // The hook which was set on the thread before
+  lua_Hook hook;
+  int hook_mask;
+  int hook_count;
+};
+
+// The budget of the innermost resume in progress on this thread
+inline budget_state *&
+current_budget() {
+  static thread_local budget_state * ptr = nullptr;
+  return ptr;
+}
+
+inline void
+budget_hook(lua_State * L, lua_Debug * ar) {
+  budget_state * s = current_budget();
+  if (!s) {
+    // This thread was created during a budget, and inherited the hook
+    lua_sethook(L, nullptr, 0, 0);
+    return;
+  }
+
+  if (ar->event != LUA_HOOKCOUNT) {
+    if (s->hook) { s->hook(L, ar); }
+    return;
+  }
+
+  // Threads created by the coroutine inherit the hook. Their instructions
+  // count against the budget, but only the coroutine itself can be preempted.
+  bool exhausted = false;
+  if (s->instructions_left) {
+    s->instructions_left -= s->interval;
+    if (s->instructions_left <= 0) {
+      s->instructions_left = 0;
+      exhausted = true;
+    }
+  }
+  if (s->has_deadline && budget::clock::now() >= s->deadline) {
+    exhausted = true;
+  }
+
+  if (exhausted && L == s->thread && lua_isyieldable(L)) {
+    s->preempted = true;
+    lua_sethook(L, s->hook, s->hook_mask, s->hook_count);
+    lua_yield(L, 0);
+  }
+}
+
+// Installs the budget on a thread for the lifetime of this object.
+// Does nothing if the budget is empty.
+class budget_scope {
+  budget_state state_;
+  budget_state * prev_;
+  bool active_;
+
+public:
+  budget_scope(lua_State * T, const budget & b) noexcept
+    : state_()
+    , prev_(nullptr)
+    , active_(static_cast<bool>(b)) {
+    if (active_) {
+      state_.thread = T;
+      state_.instructions_left = b.instructions > 0 ? b.instructions : 0;
+      state_.interval = b.check_interval > 0 ? b.check_interval : 1;
+      if (state_.instructions_left
+          && state_.instructions_left < state_.interval) {
+        state_.interval = static_cast<int>(state_.instructions_left);
+      }
+      state_.has_deadline = b.time > budget::clock::duration::zero();
+      if (state_.has_deadline) {
+        state_.deadline = budget::clock::now() + b.time;
+      }
+      state_.preempted = false;
+
+      state_.hook = lua_gethook(T);
+      state_.hook_mask = lua_gethookmask(T);
+      state_.hook_count = lua_gethookcount(T);
+      if (state_.hook == &budget_hook) {
+        state_.hook = nullptr;
+        state_.hook_mask = 0;
+        state_.hook_count = 0;
+      }
+
+      prev_ = current_budget();
+      current_budget() = &state_;
+      lua_sethook(T, &budget_hook, state_.hook_mask | LUA_MASKCOUNT,
+                  state_.interval);
+    }
+  }
+
+  ~budget_scope() noexcept {
+    if (active_) {
+      lua_sethook(state_.thread, state_.hook, state_.hook_mask,
+                  state_.hook_count);
+      current_budget() = prev_;
+    }
+  }
+
+  budget_scope(const budget_scope &) = delete;
+  budget_scope & operator=(const budget_scope &) = delete;
+
+  bool preempted() const noexcept { return active_ && state_.preempted; }
+};
+
+} // end namespace detail
+
+} // end namespace primer
@@ -0,0 +1,412 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_call_stats_docu
+
+/*`
+If `PRIMER_CALL_STATS` is defined, every call of a `primer::bound_function`
+and every resume of a `primer::coroutine` is counted and timed. Statistics are
+kept per lua function, identified by its `debug_string()`.
+
+Latencies are recorded in a log-linear histogram, like HDR histograms: every
+power of two of nanoseconds is split into 8 buckets, so that percentiles are
+accurate to within 12.5%.
+
+Recording is lock-free. Each thread keeps its own table, which is only locked
+when a function is called for the first time in a VM. After that, the VM finds
+the statistics of the function in a weak table in its registry. `snapshot()`
+merges the tables of all threads.
+
+The callbacks of an api, declared with `NEW_LUA_CALLBACK` or
+`USE_LUA_CALLBACK`, are also counted and timed, under their names. Their
+statistics are returned by `callback_snapshot()`. A call counts as an error if
+it signals one through `primer::result`, `expected`, or a bad argument.
+
+A call is counted, as an error, before it starts, and the error is taken back
+when it returns successfully. So a call which is unwound by `lua_error`, for
+instance from a raw `lua_CFunction` callback, still counts as a failed call,
+but its time is not recorded. Calls which are still running count as errors.
+
+If `PRIMER_CALL_STATS` is not defined, nothing is recorded and the snapshots
+are empty.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+#include <primer/push_singleton.hpp>
+#include <primer/support/describe_function.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef PRIMER_CALL_STATS
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#endif
+
+namespace primer {
+
+namespace detail {
+
+// Buckets 0 - 7 hold 0 - 7 ns exactly, then each power of two is split in 8.
+// Durations of 2^40 ns (about 18 minutes) and more share the last bucket.
+static constexpr std::size_t call_stats_max_exponent = 40;
+static constexpr std::size_t call_stats_buckets =
+  (call_stats_max_exponent - 2) * 8 + 1;
+
+inline std::size_t
+call_stats_bucket(std::uint64_t ns) noexcept {
+  if (ns < 8) { return static_cast<std::size_t>(ns); }
+  std::size_t e = 0;
+  while ((ns >> e) > 1) {
+    ++e;
+  }
+  if (e >= call_stats_max_exponent) { return call_stats_buckets - 1; }
+  return (e - 2) * 8 + static_cast<std::size_t>((ns >> (e - 3)) & 7);
+}
+
+// The smallest duration which falls into a bucket
+inline std::uint64_t
+call_stats_bucket_lower(std::size_t idx) noexcept {
+  if (idx < 8) { return idx; }
+  return static_cast<std::uint64_t>(8 + idx % 8) << (idx / 8 - 1);
+}
+
+} // end namespace detail
+
+//[ primer_call_stats
+struct call_stats {
+  /*<< The `debug_string()` of the function >>*/
+  std::string name;
+  std::uint64_t calls;
+  std::uint64_t errors;
+  /*<< Total time spent in the function >>*/
+  std::chrono::nanoseconds total;
+  /*<< Number of calls per latency bucket >>*/
+  std::vector<std::uint64_t> histogram;
+
+  /*<< An upper bound for the latency of the given fraction of calls, e.g.
+       `percentile(0.99)` >>*/
+  std::chrono::nanoseconds percentile(double p) const noexcept;
+
+  /*<< Get statistics of all functions, from all threads >>*/
+  static std::vector<call_stats> snapshot();
+
+  /*<< Get statistics of all api callbacks, from all threads >>*/
+  static std::vector<call_stats> callback_snapshot();
+
+  /*<< Clear all statistics >>*/
+  static void reset() noexcept;
+};
+//]
+
+inline std::chrono::nanoseconds
+call_stats::percentile(double p) const noexcept {
+  std::uint64_t total = 0;
+  for (std::uint64_t c : histogram) {
+    total += c;
+  }
+  if (!total) { return std::chrono::nanoseconds::zero(); }
+
+  p = std::min(std::max(p, 0.0), 1.0);
+  std::uint64_t target = static_cast<std::uint64_t>(p * total);
+  if (!target) { target = 1; }
+
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < histogram.size(); ++i) {
+    seen += histogram[i];
+    if (seen >= target) {
+      auto upper = detail::call_stats_bucket_lower(i + 1);
+      return std::chrono::nanoseconds(upper - 1);
+    }
+  }
+  return std::chrono::nanoseconds(
+    detail::call_stats_bucket_lower(histogram.size()));
+}
+
+#ifdef PRIMER_CALL_STATS
+
+namespace detail {
+
+struct call_stats_entry {
+  std::atomic<std::uint64_t> calls{0};
+  std::atomic<std::uint64_t> errors{0};
+  std::atomic<std::uint64_t> total_ns{0};
+  std::atomic<std::uint64_t> buckets[call_stats_buckets];
+
+  call_stats_entry() noexcept {
+    for (auto & b : buckets) {
+      b.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Count the call as failed, in case it is unwound by a lua error
+  void start() noexcept {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    errors.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void finish(std::uint64_t ns, bool ok) noexcept {
+    if (ok) { errors.fetch_sub(1, std::memory_order_relaxed); }
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    buckets[call_stats_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+using call_stats_map =
+  std::map<std::string, std::unique_ptr<call_stats_entry>>;
+
+// The statistics recorded by one thread. Entries are never removed, so they
+// may be referred to from any thread, as long as the program runs.
+struct call_stats_table {
+  // Guarded by mutex, read by snapshots
+  std::mutex mutex;
+  call_stats_map by_name;
+  call_stats_map callbacks;
+};
+
+struct call_stats_global {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<call_stats_table>> tables;
+};
+
+inline call_stats_global &
+get_call_stats_global() {
+  static call_stats_global g;
+  return g;
+}
+
+inline call_stats_table &
+get_call_stats_table() {
+  static thread_local std::shared_ptr<call_stats_table> t = []() {
+    auto result = std::make_shared<call_stats_table>();
+    call_stats_global & g = get_call_stats_global();
+    std::lock_guard<std::mutex> lock{g.mutex};
+    g.tables.push_back(result);
+    return result;
+  }();
+  return *t;
+}
+
+using call_stats_handle = call_stats_entry *;
+
+// A weak table in the registry, from lua functions to their entries, so that
+// the name is only formatted the first time a function is called. Functions
+// which are collected drop out of it.
+inline void
+call_stats_cache(lua_State * L) {
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushliteral(L, "k");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+}
+
+// Find the entry for the function on top of the stack, by its name. Pops it.
+// Returns nullptr if memory allocation fails.
+inline call_stats_handle
+call_stats_find(lua_State * L) noexcept {
+  int top = lua_gettop(L) - 1;
+  PRIMER_TRY_BAD_ALLOC {
+    std::string name = detail::describe_function(L);
+
+    call_stats_table & t = get_call_stats_table();
+    std::lock_guard<std::mutex> lock{t.mutex};
+    std::unique_ptr<call_stats_entry> & e = t.by_name[name];
+    if (!e) { e.reset(new call_stats_entry); }
+    return e.get();
+  }
+  PRIMER_CATCH_BAD_ALLOC { lua_settop(L, top); }
+  return nullptr;
+}
+
+// Find the entry for the function at index `idx`.
+// Returns nullptr if memory allocation fails.
+// Can cause lua memory allocation failure.
+inline call_stats_handle
+call_stats_lookup(lua_State * L, int idx) {
+  if (!lua_checkstack(L, 3)) { return nullptr; }
+  idx = lua_absindex(L, idx);
+
+  push_singleton<&call_stats_cache>(L);
+  lua_pushvalue(L, idx);
+  lua_rawget(L, -2);
+  call_stats_handle result = static_cast<call_stats_handle>(
+    lua_touserdata(L, -1));
+  lua_pop(L, 1);
+
+  if (!result) {
+    lua_pushvalue(L, idx);
+    result = call_stats_find(L);
+    if (result) {
+      lua_pushvalue(L, idx);
+      lua_pushlightuserdata(L, result);
+      lua_rawset(L, -3);
+    }
+  }
+  lua_pop(L, 1);
+  return result;
+}
+
+// Find the entry for the api callback called `name`.
+// Returns nullptr if memory allocation fails.
+inline call_stats_handle
+call_stats_callback(const char * name) noexcept {
+  PRIMER_TRY_BAD_ALLOC {
+    call_stats_table & t = get_call_stats_table();
+    std::lock_guard<std::mutex> lock{t.mutex};
+    std::unique_ptr<call_stats_entry> & e = t.callbacks[name];
+    if (!e) { e.reset(new call_stats_entry); }
+    return e.get();
+  }
+  PRIMER_CATCH_BAD_ALLOC {}
+  return nullptr;
+}
+
+class call_timer {
+  call_stats_handle entry_;
+  std::chrono::steady_clock::time_point start_;
+
+public:
+  explicit call_timer(call_stats_handle e) noexcept
+    : entry_(e)
+    , start_(e ? std::chrono::steady_clock::now()
+               : std::chrono::steady_clock::time_point{}) {
+    if (entry_) { entry_->start(); }
+  }
+
+  void stop(bool ok) noexcept {
+    if (entry_) {
+      auto d = std::chrono::steady_clock::now() - start_;
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+      entry_->finish(static_cast<std::uint64_t>(ns.count()), ok);
+    }
+  }
+};
+
+inline std::vector<call_stats>
+call_stats_merge(call_stats_map call_stats_table::*which) {
+  std::map<std::string, call_stats> merged;
+
+  call_stats_global & g = get_call_stats_global();
+  std::lock_guard<std::mutex> glock{g.mutex};
+  for (const auto & t : g.tables) {
+    std::lock_guard<std::mutex> lock{t->mutex};
+    for (const auto & p : (*t).*which) {
+      call_stats & s = merged[p.first];
+      if (s.histogram.empty()) {
+        s.name = p.first;
+        s.calls = 0;
+        s.errors = 0;
+        s.total = std::chrono::nanoseconds::zero();
+        s.histogram.resize(call_stats_buckets);
+      }
+      const call_stats_entry & e = *p.second;
+      s.calls += e.calls.load(std::memory_order_relaxed);
+      s.errors += e.errors.load(std::memory_order_relaxed);
+      s.total += std::chrono::nanoseconds(
+        e.total_ns.load(std::memory_order_relaxed));
+      for (std::size_t i = 0; i < call_stats_buckets; ++i) {
+        s.histogram[i] += e.buckets[i].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  std::vector<call_stats> result;
+  result.reserve(merged.size());
+  for (auto & p : merged) {
+    result.emplace_back(std::move(p.second));
+  }
+  return result;
+}
+
+inline void
+call_stats_clear(call_stats_map & m) noexcept {
+  for (const auto & p : m) {
+    call_stats_entry & e = *p.second;
+    e.calls.store(0, std::memory_order_relaxed);
+    e.errors.store(0, std::memory_order_relaxed);
+    e.total_ns.store(0, std::memory_order_relaxed);
+    for (auto & b : e.buckets) {
+      b.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+} // end namespace detail
+
+inline std::vector<call_stats>
+call_stats::snapshot() {
+  return detail::call_stats_merge(&detail::call_stats_table::by_name);
+}
+
+inline std::vector<call_stats>
+call_stats::callback_snapshot() {
+  return detail::call_stats_merge(&detail::call_stats_table::callbacks);
+}
+
+inline void
+call_stats::reset() noexcept {
+  detail::call_stats_global & g = detail::get_call_stats_global();
+  std::lock_guard<std::mutex> glock{g.mutex};
+  for (const auto & t : g.tables) {
+    std::lock_guard<std::mutex> lock{t->mutex};
+    detail::call_stats_clear(t->by_name);
+    detail::call_stats_clear(t->callbacks);
+  }
+}
+
+#else // PRIMER_CALL_STATS
+
+namespace detail {
+
+struct call_stats_handle {};
+
+inline call_stats_handle
+call_stats_lookup(lua_State *, int) {
+  return {};
+}
+
+inline call_stats_handle
+call_stats_callback(const char *) noexcept {
+  return {};
+}
+
+struct call_timer {
+  explicit call_timer(call_stats_handle) noexcept {}
+  void stop(bool) noexcept {}
+};
+
+} // end namespace detail
+
+inline std::vector<call_stats>
+call_stats::snapshot() {
+  return {};
+}
+
+inline std::vector<call_stats>
+call_stats::callback_snapshot() {
+  return {};
+}
+
+inline void
+call_stats::reset() noexcept {}
+
+#endif // PRIMER_CALL_STATS
+
+} // end namespace primer
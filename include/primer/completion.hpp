@@ -0,0 +1,198 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_completion_docu
+
+/*`
+`primer::completion<T>` lets a callback adapted with `PRIMER_ADAPT` suspend
+the calling coroutine until a C++ operation produces a value of type `T`.
+
+The callback creates a `completion<T>`, arranges for it to be completed later,
+e.g. by keeping a copy in a list of pending requests, and returns it. Then the
+coroutine yields the underlying `primer::async_op`, so it is understood by
+`<primer/await.hpp>`, using `lua_yieldk` with a continuation.
+
+When the coroutine is resumed, the continuation pushes the value given to
+`complete` as the results of the call. Tuples and pairs give several results.
+If the operation failed, a lua error with its message is raised in the script
+instead, and resuming before the operation completes is also an error.
+
+If the completion is already complete when the callback returns, the results
+are returned directly, without yielding.
+
+Like `async_op`, `complete` and `fail` should be called on the thread which
+runs the VM.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/async_op.hpp>
+#include <primer/error.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/lua_ref_seq.hpp>
+#include <primer/push.hpp>
+#include <primer/push_singleton.hpp>
+#include <primer/result.hpp>
+#include <primer/support/implement_result.hpp>
+
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
+
+namespace primer {
+
+//[ primer_completion
+template <typename T>
+class completion {
+  //<-
+  struct state {
+    expected<T> value;
+    async_op op;
+  };
+
+  std::shared_ptr<state> state_;
+
+  //->
+public:
+  /*<< Throws `std::bad_alloc` >>*/
+  completion()
+    : state_(std::make_shared<state>(
+        state{primer::error{"operation is not complete"}, async_op{}})) {}
+
+  bool ready() const noexcept { return state_->op.ready(); }
+
+  /*<< Complete the operation with a value >>*/
+  void complete(T value) {
+    state_->value = std::move(value);
+    state_->op.complete(lua_ref_seq{});
+  }
+
+  /*<< Fail the operation, raising an error in the script >>*/
+  void fail(primer::error e) {
+    state_->value = e;
+    state_->op.fail(std::move(e));
+  }
+
+  /*<< The result, once the operation is ready >>*/
+  const expected<T> & result() const noexcept { return state_->value; }
+
+  /*<< The operation which is yielded to the resumer >>*/
+  const async_op & op() const noexcept { return state_->op; }
+};
+//]
+
+namespace detail {
+
+// Push the value of a completion, as one or several results
+template <typename T>
+struct completion_values {
+  static primer::result push(lua_State * L, const T & t) {
+    constexpr int space = primer::stack_space_for_push<T>();
+    if (!lua_checkstack(L, space)) {
+      return primer::error::insufficient_stack_space(space);
+    }
+    primer::push(L, t);
+    return 1;
+  }
+};
+
+template <typename... Ts>
+struct completion_values<std::tuple<Ts...>> : return_values<std::tuple<Ts...>> {
+};
+
+template <typename T, typename U>
+struct completion_values<std::pair<T, U>> : return_values<std::pair<T, U>> {};
+
+// The completion is kept in a userdata on the stack of the coroutine while it
+// is suspended, and its stack index is the context of the continuation.
+template <typename T>
+struct completion_udata {
+  static int gc(lua_State * L) {
+    static_cast<completion<T> *>(lua_touserdata(L, 1))->~completion<T>();
+    lua_pushnil(L);
+    lua_setmetatable(L, 1);
+    return 0;
+  }
+
+  static void push_metatable(lua_State * L) {
+    lua_newtable(L);
+    lua_pushcfunction(L, &completion_udata::gc);
+    lua_setfield(L, -2, "__gc");
+  }
+
+  static void push(lua_State * L, const completion<T> & c) {
+    new (lua_newuserdata(L, sizeof(completion<T>))) completion<T>(c);
+    push_singleton<&completion_udata::push_metatable>(L);
+    lua_setmetatable(L, -2);
+  }
+
+  static primer::result finish(const completion<T> & c, lua_State * L) {
+    if (!c.ready()) {
+      return primer::error{"coroutine was resumed before the operation "
+                           "completed"};
+    }
+    if (!c.result()) { return c.result().err(); }
+    return completion_values<T>::push(L, *c.result());
+  }
+
+  static int continuation(lua_State * L, int, lua_KContext ctx) {
+    int idx = static_cast<int>(ctx);
+    auto temp = detail::implement_result_step_one(
+      L, finish(*static_cast<completion<T> *>(lua_touserdata(L, idx)), L));
+    return detail::implement_result_step_two(L, temp);
+  }
+};
+
+// Adapt `f` by wrapping it in a function returning primer::result, which
+// yields with a continuation.
+template <typename F, F f>
+struct adapt_completion;
+
+template <typename T, typename... Args,
+          completion<T> (*f)(lua_State *, Args...)>
+struct adapt_completion<completion<T> (*)(lua_State *, Args...), f> {
+  using udata = completion_udata<T>;
+
+  static primer::result call(lua_State * L, Args... args) {
+    completion<T> c = f(L, std::forward<Args>(args)...);
+    if (c.ready()) { return udata::finish(c, L); }
+
+    if (!lua_checkstack(L, 2)) {
+      return primer::error::insufficient_stack_space(2);
+    }
+    udata::push(L, c);
+    lua_KContext ctx = lua_gettop(L);
+    c.op().push(L);
+    return primer::yield_k{1, &udata::continuation, ctx};
+  }
+
+  static primer::return_or_yield adapted_result(lua_State * L) {
+    return adapt<primer::result (*)(lua_State *, Args...),
+                 &call>::adapted_result(L);
+  }
+
+  static int adapted(lua_State * L) {
+    return adapt<primer::result (*)(lua_State *, Args...), &call>::adapted(L);
+  }
+};
+
+} // end namespace detail
+
+template <typename T, typename... Args,
+          completion<T> (*target_func)(lua_State * L, Args...)>
+class adapt<completion<T> (*)(lua_State * L, Args...), target_func>
+  : public detail::adapt_completion<completion<T> (*)(lua_State * L, Args...),
+                                    target_func> {};
+
+} // end namespace primer
@@ -12,3 +12,6 @@
 /* #define PRIMER_NO_STATIC_ASSERTS */
 /* #define PRIMER_NO_EXCEPTIONS */
 /* #define PRIMER_NO_MEMORY_FAILURE */
+
+/* #define PRIMER_COROUTINE_POOL_SIZE 0 */
+/* #define PRIMER_CALL_STATS */
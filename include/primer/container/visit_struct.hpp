@@ -24,6 +24,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/expected.hpp>
 #include <primer/lua.hpp>
 #include <primer/support/asserts.hpp>
+#include <primer/support/auto_persist.hpp>
 #include <primer/traits/push.hpp>
 #include <primer/traits/read.hpp>
 
@@ -171,4 +172,54 @@ struct read<T, enable_if_t<visit_struct::traits::is_visitable<T>::value>> {
 
 } // end namespace traits
 
+/***
+ * Binary encoding of visitable structures, field by field, for generated
+ * persistence of userdata. Trivially copyable structures are encoded this way
+ * too, so that a pointer field is rejected rather than copied.
+ */
+
+namespace detail {
+
+template <typename T>
+struct has_field_codec<
+  T, enable_if_t<visit_struct::traits::is_visitable<T>::value>>
+  : std::true_type {};
+
+template <typename T>
+struct binary_codec<T,
+                    enable_if_t<visit_struct::traits::is_visitable<T>::value>> {
+  struct writer {
+    luaL_Buffer * b;
+
+    template <typename U>
+    void operator()(const char *, const U & u) {
+      binary_codec<U>::write(b, u);
+    }
+  };
+
+  struct reader {
+    const char *& pos;
+    const char * end;
+    bool ok;
+
+    template <typename U>
+    void operator()(const char *, U & u) {
+      if (ok) { ok = binary_codec<remove_cv_t<U>>::read(pos, end, u); }
+    }
+  };
+
+  static void write(luaL_Buffer * b, const T & t) {
+    writer vis{b};
+    visit_struct::apply_visitor(vis, t);
+  }
+
+  static bool read(const char *& pos, const char * end, T & t) {
+    reader vis{pos, end, true};
+    visit_struct::apply_visitor(vis, t);
+    return vis.ok;
+  }
+};
+
+} // end namespace detail
+
 } // end namespace primer
@@ -30,6 +30,14 @@ It can only be constructed from a primer::bound_function.
 If a coroutine returns, or raises an error, then the coroutine object will
 become invalid to call. A new coroutine can be made from the bound_function.
 
+A `primer::budget` can be set on the coroutine, to limit the number of
+instructions or the time that each call may run. When it is exhausted, the
+coroutine is preempted, and the next call continues the same execution.
+
+Optionally, threads of coroutines which returned normally are kept in a small
+per-VM pool, and reused when new coroutines are created. This is disabled by
+default, see `PRIMER_COROUTINE_POOL_SIZE`.
+
 Not everything that you can do with coroutines can be done with this object.
 If you need fine-grained control then you should do it manually using the C
 API.
@@ -42,6 +50,8 @@ API.
 PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/bound_function.hpp>
+#include <primer/budget.hpp>
+#include <primer/call_stats.hpp>
 #include <primer/cpp_pcall.hpp>
 #include <primer/expected.hpp>
 #include <primer/lua.hpp>
@@ -50,6 +60,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/support/function.hpp>
 #include <primer/support/function_check_stack.hpp>
 #include <primer/support/function_return.hpp>
+#include <primer/support/thread_pool.hpp>
 
 namespace primer {
 
@@ -58,9 +69,22 @@ class coroutine {
 
   lua_ref ref_;
   lua_State * thread_stack_;
+  budget budget_;
+  bool preempted_;
+  detail::call_stats_handle stats_;
 
   //<-
 
+  // Resume the thread, with the budget installed if there is one
+  template <typename return_type>
+  void resume_call(expected<return_type> & result, int narg) {
+    detail::call_timer timer{stats_};
+    detail::budget_scope scope{thread_stack_, budget_};
+    detail::resume_call(result, thread_stack_, narg);
+    preempted_ = scope.preempted();
+    timer.stop(static_cast<bool>(result));
+  }
+
   // Takes one of the structures `detail::return_none`, `detail::return_one`,
   // `detail::return_many` as first parameter
   template <typename return_type, typename... Args>
@@ -72,8 +96,13 @@ class coroutine {
         if (auto check =
               detail::check_stack_push_each<Args...>(thread_stack_)) {
           auto ok = primer::mem_pcall(L, [&]() {
-            primer::push_each(thread_stack_, std::forward<Args>(args)...);
-            detail::resume_call(result, thread_stack_, sizeof...(Args));
+            int narg = 0;
+            if (!preempted_) {
+              primer::push_each(thread_stack_, std::forward<Args>(args)...);
+              narg = sizeof...(Args);
+            }
+            this->resume_call(result, narg);
+            detail::recycle_thread(L, thread_stack_);
           });
 
           if (!ok) { result = std::move(ok.err()); }
@@ -99,8 +128,13 @@ class coroutine {
       if (lua_State * L = ref_.lock()) {
         if (auto c = detail::check_stack_push_n(thread_stack_, inputs.size())) {
           auto ok = primer::mem_pcall(L, [&]() {
-            inputs.push_each(thread_stack_);
-            detail::resume_call(result, thread_stack_, inputs.size());
+            int narg = 0;
+            if (!preempted_) {
+              inputs.push_each(thread_stack_);
+              narg = static_cast<int>(inputs.size());
+            }
+            this->resume_call(result, narg);
+            detail::recycle_thread(L, thread_stack_);
           });
 
           if (!ok) { result = ok.err(); }
@@ -120,7 +154,12 @@ class coroutine {
   //->
 public:
   // Special member functions
-  coroutine() noexcept : ref_(), thread_stack_(nullptr) {}
+  coroutine() noexcept
+    : ref_()
+    , thread_stack_(nullptr)
+    , budget_()
+    , preempted_(false)
+    , stats_() {}
 
   coroutine(coroutine &&) noexcept = default;
   coroutine & operator=(coroutine &&) noexcept = default;
@@ -145,6 +184,14 @@ public:
   /*<< Reset to the empty state >>*/
   void reset() noexcept;
 
+  /*<< Limit how long each call may run. If the budget is exhausted, the
+       call returns early with no values, and `preempted()` is true. >>*/
+  void set_budget(const budget & b) noexcept { budget_ = b; }
+
+  /*<< Check if the last call was preempted. The next call continues where
+       the coroutine stopped, and its arguments are discarded. >>*/
+  bool preempted() const noexcept { return preempted_; }
+
   void swap(coroutine & other) noexcept;
 
   // Call the coroutine.
@@ -184,7 +231,8 @@ inline coroutine::coroutine(const bound_function & bf) //
   : coroutine()                                        //
 {
   if (lua_State * L = bf.push()) {
-    thread_stack_ = lua_newthread(L);
+    stats_ = detail::call_stats_lookup(L, -1);
+    thread_stack_ = detail::acquire_thread(L);
     lua_insert(L, -2);              // put the thread below the function
     lua_xmove(L, thread_stack_, 1); // Move function to thread stack
     ref_ = lua_ref(L);              // Get ref to the thread
@@ -195,12 +243,16 @@ inline void
 coroutine::reset() noexcept {
   ref_.reset();
   thread_stack_ = nullptr;
+  preempted_ = false;
 }
 
 inline void
 coroutine::swap(coroutine & other) noexcept {
   ref_.swap(other.ref_);
   std::swap(thread_stack_, other.thread_stack_);
+  std::swap(budget_, other.budget_);
+  std::swap(preempted_, other.preempted_);
+  std::swap(stats_, other.stats_);
 }
 
 inline void
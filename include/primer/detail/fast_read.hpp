@@ -0,0 +1,199 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Unchecked reads of primitive values, used by PRIMER_ADAPT.
+ *
+ * For each supported type, `mask` is the set of lua types which may be read as
+ * that type, and `check` performs any test beyond the type, such as integer
+ * range. When both pass, `get` reads the value without further checks, and
+ * gives the same result as `primer::read`.
+ *
+ * When any of them fails, PRIMER_ADAPT falls back to `primer::read`, which
+ * produces the detailed error message. So the fast path only has to be
+ * accurate when it succeeds.
+ *
+ * The fast path is only enabled when `primer::traits::read<T>` is primer's
+ * own, marked by `primer_builtin`. If the user fully specializes the trait,
+ * then their specialization is used.
+ *
+ * `fast_arg` holds an argument between the checks and the call, so that a
+ * value found by `check`, like the pointer to a userdata, is not looked up
+ * again by `get`.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+#include <primer/primer_fwd.hpp>
+
+#include <primer/detail/is_userdata.hpp>
+#include <primer/detail/type_traits.hpp>
+#include <primer/support/types.hpp>
+#include <primer/userdata.hpp>
+
+#include <limits>
+#include <type_traits>
+
+namespace primer {
+namespace detail {
+
+// One bit per lua type. LUA_TNONE is -1, so everything is shifted by one.
+inline constexpr unsigned
+lua_type_bit(int t) {
+  return 1u << (t + 1);
+}
+
+static constexpr unsigned lua_type_any = ~0u;
+
+// By default, there is no fast path
+template <typename T, typename ENABLE = void>
+struct fast_read {
+  static constexpr bool enabled = false;
+};
+
+template <typename T, typename ENABLE = void>
+struct is_builtin_read : std::false_type {};
+
+template <typename T>
+struct is_builtin_read<T, typename primer::traits::read<T>::primer_builtin>
+  : std::true_type {};
+
+template <typename T, unsigned M>
+struct fast_read_base {
+  static constexpr bool enabled = is_builtin_read<T>::value;
+  static constexpr unsigned mask = M;
+  static bool check(lua_State *, int) noexcept { return true; }
+};
+
+template <>
+struct fast_read<const char *>
+  : fast_read_base<const char *, lua_type_bit(LUA_TSTRING)> {
+  static const char * get(lua_State * L, int idx) noexcept {
+    return lua_tostring(L, idx);
+  }
+};
+
+template <>
+struct fast_read<bool> : fast_read_base<bool, lua_type_bit(LUA_TBOOLEAN)> {
+  static bool get(lua_State * L, int idx) noexcept {
+    return static_cast<bool>(lua_toboolean(L, idx));
+  }
+};
+
+template <>
+struct fast_read<nil_t>
+  : fast_read_base<nil_t, lua_type_bit(LUA_TNONE) | lua_type_bit(LUA_TNIL)> {
+  static nil_t get(lua_State *, int) noexcept { return nil_t{}; }
+};
+
+template <>
+struct fast_read<truthy> : fast_read_base<truthy, lua_type_any> {
+  static truthy get(lua_State * L, int idx) noexcept {
+    return truthy{static_cast<bool>(lua_toboolean(L, idx))};
+  }
+};
+
+// Integers must have an integer representation, and fit in the target type.
+// Numeric strings are left to the slow path.
+template <typename T>
+struct fast_read<T, enable_if_t<std::is_same<T, int>::value ||           //
+                                std::is_same<T, long>::value ||          //
+                                std::is_same<T, long long>::value ||     //
+                                std::is_same<T, unsigned int>::value ||  //
+                                std::is_same<T, unsigned long>::value || //
+                                std::is_same<T, unsigned long long>::value>>
+  : fast_read_base<T, lua_type_bit(LUA_TNUMBER)> {
+  static bool check(lua_State * L, int idx) noexcept {
+    using S = typename std::make_signed<T>::type;
+    if (!lua_isinteger(L, idx)) { return false; }
+    LUA_INTEGER i = lua_tointeger(L, idx);
+    if (sizeof(S) < sizeof(LUA_INTEGER)) {
+      if (i > static_cast<LUA_INTEGER>(std::numeric_limits<S>::max())
+          || i < static_cast<LUA_INTEGER>(std::numeric_limits<S>::min())) {
+        return false;
+      }
+    }
+    return std::is_signed<T>::value || i >= 0;
+  }
+
+  static T get(lua_State * L, int idx) noexcept {
+    return static_cast<T>(lua_tointeger(L, idx));
+  }
+};
+
+template <typename T>
+struct fast_read<T, enable_if_t<std::is_same<T, float>::value ||  //
+                                std::is_same<T, double>::value || //
+                                std::is_same<T, long double>::value>>
+  : fast_read_base<T, lua_type_bit(LUA_TNUMBER)> {
+  static T get(lua_State * L, int idx) noexcept {
+    return static_cast<T>(lua_tonumber(L, idx));
+  }
+};
+
+// Userdata, the tag test is still needed. It is done by fast_arg.
+template <typename T>
+struct fast_read<T &, enable_if_t<is_userdata<T>::value>>
+  : fast_read_base<T &, lua_type_bit(LUA_TUSERDATA)> {};
+
+template <typename T>
+struct fast_read<const T &, enable_if_t<is_userdata<T>::value>>
+  : fast_read_base<const T &, lua_type_bit(LUA_TUSERDATA)> {};
+
+// An argument on the fast path, whose type mask already matched
+template <typename T, typename ENABLE = void>
+class fast_arg {
+  lua_State * L_;
+  int idx_;
+
+public:
+  fast_arg(lua_State * L, int idx) noexcept
+    : L_(L)
+    , idx_(idx) {}
+
+  bool check() noexcept { return fast_read<T>::check(L_, idx_); }
+  T get() noexcept { return fast_read<T>::get(L_, idx_); }
+};
+
+// The object may be a base subobject of a derived type, at some offset, so
+// the pointer from the test is kept
+template <typename T>
+class fast_arg<T &, enable_if_t<is_userdata<remove_cv_t<T>>::value>> {
+  lua_State * L_;
+  int idx_;
+  T * ptr_;
+
+public:
+  fast_arg(lua_State * L, int idx) noexcept
+    : L_(L)
+    , idx_(idx)
+    , ptr_(nullptr) {}
+
+  bool check() noexcept {
+    ptr_ = primer::test_udata<remove_cv_t<T>>(L_, idx_);
+    return ptr_ != nullptr;
+  }
+  T & get() noexcept { return *ptr_; }
+};
+
+// True if every type in the list has a fast path
+template <typename... Ts>
+struct all_fast_read;
+
+template <>
+struct all_fast_read<> : std::true_type {};
+
+template <typename T, typename... Ts>
+struct all_fast_read<T, Ts...>
+  : std::integral_constant<bool, fast_read<T>::enabled
+                                   && all_fast_read<Ts...>::value> {};
+
+} // end namespace detail
+} // end namespace primer
@@ -29,10 +29,15 @@ PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/detail/str_cat.hpp>
 
+#include <atomic>
+#include <cstddef>
+#include <memory>
 #include <new>
 #include <string>
 #include <utility>
 
+struct lua_State;
+
 namespace primer {
 
 //->
@@ -57,36 +62,119 @@ namespace primer {
 class error {
   //<-
 
+  // Errors raised when a value has the wrong type are the most common, and
+  // their message is often never looked at. They only store the two static
+  // strings, and the message is formatted when it is requested.
+  //
+  // Dynamic text and context lines are kept in a chain of segments, outermost
+  // context first, and the message last. Adding context only links a new
+  // segment in front, and the segments are joined when the text is requested.
+  //
+  // `what()` keeps the joined text. It is installed with a compare and swap,
+  // so that an error may be read from several threads.
   class impl {
     enum class state {
       uninitialized,
       bad_alloc,
       cant_lock_vm,
       invalid_coroutine,
+      unexpected_type,
       dynamic_text
     };
 
     using string_t = std::string;
 
-    string_t str_;
+    struct segment {
+      string_t text;
+      std::unique_ptr<segment> next;
+    };
+
     state state_;
+    const char * expected_;
+    const char * found_;
+    std::unique_ptr<segment> lines_;
+    mutable std::atomic<string_t *> formatted_;
 
-    // Helpers
-    template <typename T>
-    void initialize_string(T && t) {
-      state_ = state::dynamic_text;
-      str_ = std::forward<T>(t);
+    void reset_formatted() noexcept {
+      delete formatted_.exchange(nullptr, std::memory_order_relaxed);
+    }
+
+    // Destroy the chain iteratively, it may be long
+    void clear_lines() noexcept {
+      while (lines_) {
+        lines_ = std::move(lines_->next);
+      }
+    }
+
+    void copy_fields(const impl & other) {
+      state_ = other.state_;
+      expected_ = other.expected_;
+      found_ = other.found_;
+      std::unique_ptr<segment> * tail = &lines_;
+      for (const segment * p = other.lines_.get(); p; p = p->next.get()) {
+        tail->reset(new segment{p->text, nullptr});
+        tail = &(*tail)->next;
+      }
+    }
+
+    // The message, without context. Returns nullptr if it must be formatted.
+    const char * static_message() const noexcept {
+      switch (state_) {
+        case state::uninitialized:
+          return "uninitialized error message";
+        case state::bad_alloc:
+          return "bad_alloc";
+        case state::cant_lock_vm:
+          return "couldn't access the lua VM";
+        case state::invalid_coroutine:
+          return "invalid coroutine";
+        case state::unexpected_type:
+          return nullptr;
+        case state::dynamic_text:
+          return nullptr;
+        default:
+          return "invalid error message state";
+      }
     }
 
   public:
-    impl()
-      : str_()
-      , state_(state::uninitialized) {}
-    impl(impl && other) = default;
-    impl(const impl & other) = default;
-    impl & operator=(impl && other) = default;
-    impl & operator=(const impl & other) = default;
-    ~impl() = default;
+    impl() noexcept
+      : state_(state::uninitialized)
+      , expected_(nullptr)
+      , found_(nullptr)
+      , lines_()
+      , formatted_(nullptr) {}
+
+    impl(impl && other) noexcept : impl() { *this = std::move(other); }
+    impl(const impl & other) : impl() { this->copy_fields(other); }
+
+    impl & operator=(impl && other) noexcept {
+      if (this != &other) {
+        this->reset_formatted();
+        this->clear_lines();
+        state_ = other.state_;
+        expected_ = other.expected_;
+        found_ = other.found_;
+        lines_ = std::move(other.lines_);
+        formatted_.store(
+          other.formatted_.exchange(nullptr, std::memory_order_acq_rel),
+          std::memory_order_relaxed);
+      }
+      return *this;
+    }
+
+    impl & operator=(const impl & other) {
+      if (this != &other) {
+        impl temp{other};
+        *this = std::move(temp);
+      }
+      return *this;
+    }
+
+    ~impl() noexcept {
+      this->reset_formatted();
+      this->clear_lines();
+    }
 
     // Construct with fixed error messages
     struct bad_alloc_tag {
@@ -100,37 +188,73 @@ class error {
     };
 
     template <typename T, typename = decltype(T::value)>
-    explicit impl(T) noexcept : str_(), state_(T::value) {}
+    explicit impl(T) noexcept : impl() {
+      state_ = T::value;
+    }
+
+    // Construct "Expected foo found: 'bar'", both strings must have static
+    // storage duration
+    impl(const char * expected, const char * found) noexcept : impl() {
+      state_ = state::unexpected_type;
+      expected_ = expected;
+      found_ = found;
+    }
 
     // Construct from string
-    explicit impl(std::string s) noexcept : impl() {
-      this->initialize_string(std::move(s));
+    explicit impl(std::string s) : impl() {
+      lines_.reset(new segment{std::move(s), nullptr});
+      state_ = state::dynamic_text;
     }
 
-    // Access error message
-    const char * c_str() const {
-      switch (state_) {
-        case state::uninitialized:
-          return "uninitialized error message";
-        case state::bad_alloc:
-          return "bad_alloc";
-        case state::cant_lock_vm:
-          return "couldn't access the lua VM";
-        case state::invalid_coroutine:
-          return "invalid coroutine";
-        case state::dynamic_text:
-          return str_.c_str();
-        default:
-          return "invalid error message state";
+    // Join the context lines and the message
+    string_t str() const {
+      string_t result;
+      std::size_t size = 0;
+      for (const segment * p = lines_.get(); p; p = p->next.get()) {
+        size += p->text.size() + 1;
+      }
+      result.reserve(size);
+      for (const segment * p = lines_.get(); p; p = p->next.get()) {
+        result += p->text;
+        if (p->next || state_ != state::dynamic_text) { result += '\n'; }
+      }
+      if (const char * msg = this->static_message()) {
+        result += msg;
+      } else if (state_ == state::unexpected_type) {
+        result += detail::str_cat("Expected ", expected_, " found: '", found_,
+                                  "'");
       }
+      return result;
     }
 
-    // Get reference to dynamic string, or convert it to such.
-    std::string & str() {
-      if (state_ != state::dynamic_text) {
-        this->initialize_string(this->c_str());
+    // Access the full text, joining it at most once
+    const char * c_str() const noexcept {
+      if (!lines_) {
+        if (const char * msg = this->static_message()) { return msg; }
+      } else if (!lines_->next && state_ == state::dynamic_text) {
+        return lines_->text.c_str();
       }
-      return str_;
+
+      string_t * result = formatted_.load(std::memory_order_acquire);
+      if (!result) {
+        PRIMER_TRY_BAD_ALLOC {
+          string_t * mine = new string_t{this->str()};
+          if (formatted_.compare_exchange_strong(result, mine,
+                                                 std::memory_order_acq_rel)) {
+            result = mine;
+          } else {
+            delete mine;
+          }
+        }
+        PRIMER_CATCH_BAD_ALLOC { return "bad_alloc"; }
+      }
+      return result->c_str();
+    }
+
+    // Add a line of context, in front of the existing text
+    void add_context(string_t line) {
+      lines_.reset(new segment{std::move(line), std::move(lines_)});
+      this->reset_formatted();
     }
   };
 
@@ -139,6 +263,8 @@ class error {
   explicit error(impl m)
     : msg_(std::move(m)) {}
 
+  friend error arg_error(::lua_State *, int, const char *) noexcept;
+
   //->
 public:
   // Defaulted special member functions
@@ -202,7 +328,7 @@ public:
   // Accessor
   const char * what() const noexcept { return msg_.c_str(); }
   const char * c_str() const noexcept { return this->what(); }
-  std::string str() const { return this->what(); }
+  std::string str() const { return msg_.str(); }
 };
 
 //]
@@ -248,8 +374,7 @@ template <typename... Args>
 inline error &
 error::prepend_error_line(Args &&... args) noexcept {
   PRIMER_TRY_BAD_ALLOC {
-    std::string & s = msg_.str();
-    s = primer::detail::str_cat(std::forward<Args>(args)...) + "\n" + s;
+    msg_.add_context(primer::detail::str_cat(std::forward<Args>(args)...));
   }
   PRIMER_CATCH_BAD_ALLOC { /* msg_ = impl{impl::bad_alloc_tag{}}; */
   }
@@ -267,4 +392,13 @@ error::prepend_error_line(Args &&... args) noexcept {
 //` message as it comes up the callstack. For instance,
 //= err.prepend_error_line("In index [", idx, "] of table:");
 
+//` Each line is only linked in front of the message, and the text is joined
+//` once when it is requested, so that adding context at each level of a deeply
+//` nested structure stays cheap.
+
+//` The errors produced by `primer::arg_error`, when a value has the wrong type,
+//` do not allocate memory. They refer to the expected type and the found type,
+//` which are static strings, and the message is formatted when it is first
+//` requested.
+
 //]
@@ -66,10 +66,12 @@ push_error(lua_State * L, const primer::error & e) noexcept {
 }
 
 // Create an "unexpected value" error
+// The expected string must have static storage duration, e.g. a literal. The
+// message is only formatted if it is requested, so this does not allocate.
 inline primer::error
 arg_error(lua_State * L, int index, const char * expected) noexcept {
-  return primer::error::unexpected_value(expected,
-                                         primer::describe_lua_value(L, index));
+  return primer::error{
+    primer::error::impl{expected, primer::describe_lua_value(L, index)}};
 }
 
 } // end namespace primer
@@ -14,6 +14,9 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/push_singleton.hpp>
 #include <primer/support/asserts.hpp>
 
+#include <cstring>
+#include <string>
+
 namespace primer {
 namespace detail {
 
@@ -31,6 +34,69 @@ fetch_traceback_function(lua_State * L) noexcept {
 
 static constexpr const char * error_handler_reg_key = "primer_error_handler";
 
+// Compact traceback: the source position of each frame, recorded without
+// building any strings. Rendered to text by `primer::last_traceback`.
+struct traceback_frame {
+  char source[LUA_IDSIZE];
+  int line;
+  int linedefined;
+  char what;
+};
+
+struct traceback_record {
+  static constexpr int max_frames = 16;
+
+  int count;
+  bool truncated;
+  traceback_frame frames[max_frames];
+};
+
+inline void
+make_traceback_record(lua_State * L) {
+  void * p = lua_newuserdata(L, sizeof(traceback_record));
+  std::memset(p, 0, sizeof(traceback_record));
+}
+
+inline traceback_record *
+get_traceback_record(lua_State * L) {
+  primer::push_singleton<&make_traceback_record>(L);
+  void * p = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return static_cast<traceback_record *>(p);
+}
+
+// Error handler which records a compact traceback, returns message unchanged
+inline int
+compact_traceback_handler(lua_State * L) {
+  traceback_record * r = get_traceback_record(L);
+  r->count = 0;
+  r->truncated = false;
+
+  lua_Debug ar;
+  for (int level = 1; lua_getstack(L, level, &ar); ++level) {
+    if (r->count == traceback_record::max_frames) {
+      r->truncated = true;
+      break;
+    }
+    lua_getinfo(L, "Sl", &ar);
+    traceback_frame & f = r->frames[r->count++];
+    std::memcpy(f.source, ar.short_src, LUA_IDSIZE);
+    f.line = ar.currentline;
+    f.linedefined = ar.linedefined;
+    f.what = *ar.what;
+  }
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+// Error handler which returns the message unchanged
+inline int
+no_traceback_handler(lua_State * L) {
+  lua_settop(L, 1);
+  return 1;
+}
+
 } // end namespace detail
 
 //[ primer_error_handler_decl
@@ -42,6 +108,22 @@ inline int get_error_handler(lua_State * L) noexcept;
 inline void set_error_handler(lua_State * L) noexcept;
 //]
 
+//[ primer_traceback_mode_decl
+enum class traceback_mode {
+  full,    /*<< Default, `debug.traceback` appends a traceback to messages >>*/
+  compact, /*<< Record source positions only, render with `last_traceback` >>*/
+  none     /*<< No traceback at all >>*/
+};
+
+// Install one of the builtin error handlers.
+// Can cause lua memory allocation failure.
+inline void set_traceback_mode(lua_State * L, traceback_mode mode);
+
+// Render the traceback of the most recent error which was handled in
+// `compact` mode. Returns an empty string if there is none.
+inline std::string last_traceback(lua_State * L);
+//]
+
 //[ primer_protected_call_decl
 // Simplified version of lua_pcall which handles setting up the error handler,
 // and removing it after the pcall returns.
@@ -66,6 +148,56 @@ set_error_handler(lua_State * L) noexcept {
   lua_setfield(L, LUA_REGISTRYINDEX, detail::error_handler_reg_key);
 }
 
+inline void
+set_traceback_mode(lua_State * L, traceback_mode mode) {
+  switch (mode) {
+    case traceback_mode::compact:
+      // Create the record now, so that the handler doesn't allocate
+      detail::get_traceback_record(L);
+      lua_pushcfunction(L, &detail::compact_traceback_handler);
+      break;
+    case traceback_mode::none:
+      lua_pushcfunction(L, &detail::no_traceback_handler);
+      break;
+    default:
+      lua_pushnil(L);
+      break;
+  }
+  primer::set_error_handler(L);
+}
+
+inline std::string
+last_traceback(lua_State * L) {
+  std::string result;
+  const detail::traceback_record * r = detail::get_traceback_record(L);
+  if (r->count) {
+    result = "stack traceback:";
+    for (int i = 0; i < r->count; ++i) {
+      const detail::traceback_frame & f = r->frames[i];
+      result += "\n\t";
+      result += f.source;
+      result += ":";
+      if (f.line > 0) {
+        result += std::to_string(f.line);
+        result += ":";
+      }
+      if (f.what == 'm') {
+        result += " in main chunk";
+      } else if (f.what == 'C') {
+        result += " in ?";
+      } else {
+        result += " in function <";
+        result += f.source;
+        result += ":";
+        result += std::to_string(f.linedefined);
+        result += ">";
+      }
+    }
+    if (r->truncated) { result += "\n\t..."; }
+  }
+  return result;
+}
+
 //[ primer_protected_call_defn
 inline int
 protected_call(lua_State * L, int narg, int nret) noexcept {
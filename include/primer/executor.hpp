@@ -0,0 +1,184 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+//[ primer_executor_docu
+
+/*`
+`primer::executor` lets other threads call into a lua VM which belongs to one
+"owner" thread.
+
+Any thread may `post` a call request, consisting of a `primer::bound_function`
+and C++ arguments. The request is placed in a lock-free queue, and a
+`std::future` is returned. The owner thread calls `run_pending` periodically,
+which performs the queued calls in a batch and fulfills the futures.
+
+The results are converted to C++ values on the owner thread, using
+`primer::read`, so that no lua references cross threads. Use `void` as the
+result type if you don't need one.
+
+The executor does not close the VM. The `bound_function` objects must belong
+to the executor's VM, and must outlive the requests which name them -- they
+are used by reference, since copying them is not thread-safe.
+
+Requests which are still pending when the executor is destroyed are failed.
+ */
+
+//]
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/bound_function.hpp>
+#include <primer/detail/count.hpp>
+#include <primer/error.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/lua_ref.hpp>
+#include <primer/lua_ref_as.hpp>
+#include <primer/lua_ref_seq.hpp>
+#include <primer/support/main_thread.hpp>
+#include <primer/support/mpsc_queue.hpp>
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace primer {
+
+namespace detail {
+
+// Perform the call, and convert the result on the calling thread
+template <typename T>
+struct executor_invoke {
+  template <typename... Args>
+  static expected<T> call(const bound_function & f, Args &&... args) {
+    auto r = f.call_one_ret(std::forward<Args>(args)...);
+    if (!r) { return std::move(r.err()); }
+    return r->template as<T>();
+  }
+};
+
+template <>
+struct executor_invoke<void> {
+  template <typename... Args>
+  static expected<void> call(const bound_function & f, Args &&... args) {
+    return f.call_no_ret(std::forward<Args>(args)...);
+  }
+};
+
+} // end namespace detail
+
+//[ primer_executor
+class executor {
+  //<-
+  // A queued request. `exec` runs the request and destroys it. When `L` is
+  // null, the request is failed instead of being run.
+  struct request_base : detail::mpsc_node {
+    void (*exec)(request_base *, lua_State * L);
+  };
+
+  template <typename T, typename... Args>
+  struct request : request_base {
+    const bound_function * func;
+    std::tuple<Args...> args;
+    std::promise<expected<T>> promise;
+
+    template <std::size_t... Is>
+    expected<T> invoke(detail::SizeList<Is...>) {
+      return detail::executor_invoke<T>::call(*func,
+                                              std::move(std::get<Is>(args))...);
+    }
+
+    static void exec_impl(request_base * b, lua_State * L) {
+      request * r = static_cast<request *>(b);
+      expected<T> result{primer::error{"executor: request was cancelled"}};
+      if (L) {
+        if (r->func->lock() == L) {
+          result = r->invoke(detail::Count_t<sizeof...(Args)>{});
+        } else {
+          result = primer::error{"executor: function belongs to another VM"};
+        }
+      }
+      r->promise.set_value(std::move(result));
+      delete r;
+    }
+  };
+
+  lua_State * L_;
+  detail::mpsc_queue queue_;
+
+  //->
+public:
+  /*<< The executor is bound to the main thread of `L`. Only the owner
+       thread, which runs the VM, may call `run_pending` >>*/
+  explicit executor(lua_State * L) noexcept;
+  /*<< Fails all requests which were not run >>*/
+  ~executor() noexcept;
+
+  executor(const executor &) = delete;
+  executor & operator=(const executor &) = delete;
+
+  /*<< Thread-safe. Throws `std::bad_alloc`. The arguments are copied or moved
+       into the request. >>*/
+  template <typename T = void, typename... Args>
+  std::future<expected<T>> post(const bound_function & f, Args &&... args);
+
+  /*<< Owner thread only. Runs at most `max_batch` pending requests, in the
+       order that they were posted, and returns how many were run. >>*/
+  std::size_t run_pending(std::size_t max_batch = 64) noexcept;
+
+  /*<< Owner thread only. Approximate, a post may be in progress. >>*/
+  bool empty() const noexcept { return queue_.empty(); }
+};
+//]
+
+inline executor::executor(lua_State * L) noexcept
+  : L_(L ? main_thread(L) : nullptr)
+  , queue_() {}
+
+inline executor::~executor() noexcept {
+  while (detail::mpsc_node * n = queue_.pop()) {
+    request_base * r = static_cast<request_base *>(n);
+    r->exec(r, nullptr);
+  }
+}
+
+template <typename T, typename... Args>
+std::future<expected<T>>
+executor::post(const bound_function & f, Args &&... args) {
+  static_assert(!std::is_same<T, lua_ref>::value
+                  && !std::is_same<T, lua_ref_seq>::value,
+                "lua references cannot be passed to other threads");
+  using request_t = request<T, typename std::decay<Args>::type...>;
+
+  std::unique_ptr<request_t> r{new request_t};
+  r->exec = &request_t::exec_impl;
+  r->func = &f;
+  r->args = std::make_tuple(std::forward<Args>(args)...);
+  std::future<expected<T>> result = r->promise.get_future();
+  queue_.push(r.release());
+  return result;
+}
+
+inline std::size_t
+executor::run_pending(std::size_t max_batch) noexcept {
+  std::size_t count = 0;
+  while (count < max_batch) {
+    detail::mpsc_node * n = queue_.pop();
+    if (!n) { break; }
+    request_base * r = static_cast<request_base *>(n);
+    r->exec(r, L_);
+    ++count;
+  }
+  return count;
+}
+
+} // end namespace primer
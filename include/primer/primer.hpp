@@ -14,7 +14,11 @@
 PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/adapt.hpp>
+#include <primer/adapt_compact.hpp>
+#include <primer/adapt_overloads.hpp>
 #include <primer/bound_function.hpp>
+#include <primer/budget.hpp>
+#include <primer/call_stats.hpp>
 #include <primer/coroutine.hpp>
 #include <primer/error.hpp>
 #include <primer/error_capture.hpp>
@@ -33,8 +37,11 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/set_funcs.hpp>
 #include <primer/userdata.hpp>
 #include <primer/userdata_dispatch.hpp>
+#include <primer/varargs.hpp>
 
 #include <primer/container/map_base.hpp>
 #include <primer/container/optional_base.hpp>
 #include <primer/container/seq_base.hpp>
 #include <primer/container/set_base.hpp>
+
+#include <primer/support/auto_persist.hpp>
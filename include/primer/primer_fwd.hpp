@@ -22,6 +22,7 @@ class lua_ref;
 struct lua_ref_seq;
 class lua_state_ref;
 class result;
+class varargs;
 
 namespace traits {
 
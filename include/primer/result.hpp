@@ -14,6 +14,7 @@
 PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/expected.hpp>
+#include <primer/lua.hpp>
 
 namespace primer {
 
@@ -24,10 +25,19 @@ struct yield {
   int n_;
 };
 
+// Tag used to yield with a continuation function, see `lua_yieldk`.
+struct yield_k {
+  int n_;
+  lua_KFunction k_;
+  lua_KContext ctx_;
+};
+
 // Helper object: Represents a return or yield signal.
 struct return_or_yield {
   int n_;
   bool is_return_;
+  lua_KFunction k_;
+  lua_KContext ctx_;
 
   bool is_valid() const { return n_ >= 0; }
 };
@@ -40,9 +50,11 @@ class result {
 public:
   // Ctors (implicit for ease of use)
   result(int i)
-    : payload_(return_or_yield{i, true}) {}
+    : payload_(return_or_yield{i, true, nullptr, 0}) {}
   result(yield y)
-    : payload_(return_or_yield{y.n_, false}) {}
+    : payload_(return_or_yield{y.n_, false, nullptr, 0}) {}
+  result(yield_k y)
+    : payload_(return_or_yield{y.n_, false, y.k_, y.ctx_}) {}
   result(error e)
     : payload_(e) {}
 
@@ -18,5 +18,6 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/std/map.hpp>
 #include <primer/std/pair.hpp>
 #include <primer/std/set.hpp>
+#include <primer/std/string_view.hpp>
 #include <primer/std/unordered_map.hpp>
 #include <primer/std/vector.hpp>
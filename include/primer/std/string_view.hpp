@@ -0,0 +1,77 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * How to transfer `std::string_view` between the stack and C++.
+ *
+ * Reading a `std::string_view` does not copy the string. The view points into
+ * the lua string, so it is only valid while that string is on the stack, e.g.
+ * for the duration of a callback which takes it as a parameter.
+ *
+ * Requires C++17.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#if __cplusplus >= 201703L
+
+#include <primer/detail/fast_read.hpp>
+#include <primer/error_capture.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/traits/push.hpp>
+#include <primer/traits/read.hpp>
+
+#include <cstddef>
+#include <string_view>
+
+namespace primer {
+namespace traits {
+
+template <>
+struct push<std::string_view> {
+  static void to_stack(lua_State * L, std::string_view str) {
+    lua_pushlstring(L, str.data(), str.size());
+  }
+  static constexpr int stack_space_needed{1};
+};
+
+template <>
+struct read<std::string_view> {
+  static expected<std::string_view> from_stack(lua_State * L, int idx) {
+    if (lua_type(L, idx) == LUA_TSTRING) {
+      std::size_t len;
+      const char * str = lua_tolstring(L, idx, &len);
+      return std::string_view(str, len);
+    } else {
+      return primer::arg_error(L, idx, "string");
+    }
+  }
+  static constexpr int stack_space_needed{0};  using primer_builtin = void;
+};
+
+} // end namespace traits
+
+namespace detail {
+
+// Callbacks taking `std::string_view` use the fast path of PRIMER_ADAPT
+template <>
+struct fast_read<std::string_view>
+  : fast_read_base<std::string_view, lua_type_bit(LUA_TSTRING)> {
+  static std::string_view get(lua_State * L, int idx) noexcept {
+    std::size_t len;
+    const char * str = lua_tolstring(L, idx, &len);
+    return std::string_view(str, len);
+  }
+};
+
+} // end namespace detail
+} // end namespace primer
+
+#endif // __cplusplus >= 201703L
@@ -0,0 +1,179 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Generated persistence for userdata types.
+ *
+ * The `__persist` metamethod encodes the object as a string, and returns a
+ * closure over that string, of a reconstruct function which decodes it and
+ * pushes a new userdata. The reconstruct function is shared by all objects of
+ * the type, and is registered in the permanent objects table under the name
+ * `<udata::name>.__reconstruct`.
+ *
+ * The encoding is `binary_codec`:
+ *   - trivially copyable types are copied bytewise, except pointers
+ *   - strings are written as their length and their bytes
+ *   - visitable structures are written field by field, see
+ *     `container/visit_struct.hpp`
+ *
+ * A pointer would not be valid after unpersisting, so pointers, and visitable
+ * structures with pointer fields, are rejected at compile time. The members of
+ * other structures cannot be inspected, so they are copied as they are.
+ *
+ * The encoding depends on the platform, like eris' own format.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/error.hpp>
+#include <primer/lua.hpp>
+#include <primer/result.hpp>
+#include <primer/userdata.hpp>
+
+#include <primer/detail/type_traits.hpp>
+
+#include <primer/support/asserts.hpp>
+#include <primer/support/auto_persist_fwd.hpp>
+
+#include <primer/traits/userdata.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace primer {
+
+namespace detail {
+
+/***
+ * Should provide
+ *   static void write(luaL_Buffer *, const T &);
+ *   static bool read(const char *& pos, const char * end, T &);
+ * where `read` advances `pos`, and returns false if the data is invalid.
+ */
+template <typename T, typename ENABLE = void>
+struct binary_codec;
+
+// Types which are encoded field by field even if they are trivially copyable
+template <typename T, typename ENABLE = void>
+struct has_field_codec : std::false_type {};
+
+template <typename T>
+struct binary_codec<T, enable_if_t<std::is_trivially_copyable<T>::value
+                                   && !has_field_codec<T>::value>> {
+  using element_type = typename std::remove_all_extents<T>::type;
+
+  PRIMER_STATIC_ASSERT(!std::is_pointer<element_type>::value
+                         && !std::is_member_pointer<element_type>::value,
+                       "auto_persist cannot persist a pointer");
+
+  static void write(luaL_Buffer * b, const T & t) {
+    luaL_addlstring(b, reinterpret_cast<const char *>(&t), sizeof(T));
+  }
+
+  static bool read(const char *& pos, const char * end, T & t) noexcept {
+    if (static_cast<std::size_t>(end - pos) < sizeof(T)) { return false; }
+    std::memcpy(static_cast<void *>(&t), pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+};
+
+template <>
+struct binary_codec<std::string> {
+  using size_codec = binary_codec<std::size_t>;
+
+  static void write(luaL_Buffer * b, const std::string & s) {
+    size_codec::write(b, s.size());
+    luaL_addlstring(b, s.data(), s.size());
+  }
+
+  // May throw bad_alloc
+  static bool read(const char *& pos, const char * end, std::string & s) {
+    std::size_t n;
+    if (!size_codec::read(pos, end, n)) { return false; }
+    if (static_cast<std::size_t>(end - pos) < n) { return false; }
+    s.assign(pos, n);
+    pos += n;
+    return true;
+  }
+};
+
+template <typename T>
+struct auto_persist {
+  using udata = primer::traits::userdata<T>;
+  using codec = binary_codec<T>;
+
+  PRIMER_STATIC_ASSERT(std::is_default_constructible<T>::value,
+                       "auto_persist requires a default constructible type");
+
+  // [ud]
+  static primer::result persist_impl(lua_State * L, const T & t) {
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    codec::write(&b, t);
+    luaL_pushresult(&b);
+    lua_pushcclosure(L, &reconstruct, 1);
+    return 1;
+  }
+
+  static primer::result reconstruct_impl(lua_State * L) {
+    std::size_t len;
+    const char * pos = lua_tolstring(L, lua_upvalueindex(1), &len);
+    const char * end = pos + len;
+
+    bool ok = false;
+    T t{};
+    if (pos) {
+      PRIMER_TRY_BAD_ALLOC { ok = codec::read(pos, end, t) && pos == end; }
+      PRIMER_CATCH_BAD_ALLOC { return primer::error::bad_alloc(); }
+    }
+    if (!ok) {
+      const char * name = udata::name;
+      return primer::error("Could not reconstruct userdata '", name,
+                           "' from persisted data");
+    }
+
+    PRIMER_TRY_BAD_ALLOC { primer::push_udata<T>(L, std::move(t)); }
+    PRIMER_CATCH_BAD_ALLOC { return primer::error::bad_alloc(); }
+    return 1;
+  }
+
+  static int persist(lua_State * L) {
+    return adapt<decltype(&persist_impl), &persist_impl>::adapted(L);
+  }
+
+  static int reconstruct(lua_State * L) {
+    return adapt<decltype(&reconstruct_impl), &reconstruct_impl>::adapted(L);
+  }
+
+  // Permanent objects
+  static void populate(lua_State * L) {
+    PRIMER_ASSERT_STACK_NEUTRAL(L);
+    PRIMER_ASSERT_TABLE(L);
+    lua_pushfstring(L, "%s.__reconstruct", udata::name);
+    lua_pushcfunction(L, &reconstruct);
+    lua_settable(L, -3);
+  }
+
+  static void populate_reverse(lua_State * L) {
+    PRIMER_ASSERT_STACK_NEUTRAL(L);
+    PRIMER_ASSERT_TABLE(L);
+    lua_pushcfunction(L, &reconstruct);
+    lua_pushfstring(L, "%s.__reconstruct", udata::name);
+    lua_settable(L, -3);
+  }
+};
+
+} // end namespace detail
+
+} // end namespace primer
@@ -0,0 +1,44 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Declarations for generated persistence of userdata types, which is enabled
+ * by `static constexpr bool auto_persist = true;` in the userdata trait.
+ *
+ * The metatable and the permanents only need to know whether it is enabled,
+ * the implementation is in `auto_persist.hpp`.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/detail/type_traits.hpp>
+#include <primer/traits/userdata.hpp>
+
+#include <type_traits>
+
+namespace primer {
+
+namespace detail {
+
+template <typename T, typename ENABLE = void>
+struct auto_persist_enabled : std::false_type {};
+
+template <typename T>
+struct auto_persist_enabled<
+  T, enable_if_t<primer::traits::userdata<T>::auto_persist>>
+  : std::true_type {};
+
+// Should provide `static int persist(lua_State *)`, the `__persist`
+// metamethod, and `populate` and `populate_reverse` for the permanents
+template <typename T>
+struct auto_persist;
+
+} // end namespace detail
+
+} // end namespace primer
@@ -0,0 +1,47 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Describe the function on top of the stack using the lua debug api, e.g.
+ * "function [string "..."]:12]". Pops the function. Not noexcept, it can
+ * throw std::bad_alloc.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+
+#include <string>
+
+namespace primer {
+
+namespace detail {
+
+inline std::string
+describe_function(lua_State * L) {
+  std::string result{"function "};
+  lua_Debug ar;
+  if (lua_getinfo(L, ">nS", &ar)) {
+    result = "";
+    if (*ar.namewhat) { result = ar.namewhat + (" " + result); }
+    if (ar.name) { result += ar.name; }
+    result += " [";
+    result += ar.short_src;
+    result += ":";
+    result += std::to_string(ar.linedefined);
+    result += "]";
+  } else {
+    result += "(unknown)";
+  }
+  return result;
+}
+
+} // end namespace detail
+
+} // end namespace primer
@@ -20,6 +20,7 @@ PRIMER_ASSERT_FILESCOPE;
 namespace primer {
 
 /// Generate an error message string describing a value at a given position.
+/// The string has static storage duration.
 inline const char *
 describe_lua_value(lua_State * L, int idx) {
   return lua_typename(L, lua_type(L, idx));
@@ -46,7 +46,7 @@ implement_result_step_one(lua_State * L, primer::result r) {
     // Implementation note: This push can raise a memory error, but in
     // that case it must be an exception, so `r` is destroyed and nothing else
     // is leaked. We were going to raise an error anyways, so its okay.
-    return primer::return_or_yield{-1, true};
+    return primer::return_or_yield{-1, true, nullptr, 0};
   }
 }
 
@@ -56,7 +56,7 @@ implement_result_step_two(lua_State * L, primer::return_or_yield r) {
     if (r.is_return_) {
       return r.n_;
     } else {
-      return lua_yield(L, r.n_);
+      return lua_yieldk(L, r.n_, r.ctx_, r.k_);
     }
   } else {
     return lua_error(L);
@@ -21,10 +21,14 @@ PRIMER_ASSERT_FILESCOPE;
 
 #include <primer/detail/luaL_Reg.hpp>
 #include <primer/detail/type_traits.hpp>
+#include <primer/detail/typelist.hpp>
 
 #include <primer/support/asserts.hpp>
+#include <primer/support/auto_persist_fwd.hpp>
 #include <primer/support/diagnostics.hpp>
+#include <primer/support/udata_tag.hpp>
 #include <primer/support/userdata_common.hpp>
+#include <primer/support/userdata_fields_fwd.hpp>
 
 #include <primer/traits/userdata.hpp>
 
@@ -36,6 +40,24 @@ namespace primer {
 
 namespace detail {
 
+// Copies the methods of the bases of a userdata type, see below
+template <typename L>
+struct inherit_methods;
+
+// Installs the generated `__persist`, if enabled
+template <typename T>
+auto
+set_auto_persist(lua_State * L)
+  -> enable_if_t<auto_persist_enabled<T>::value> {
+  lua_pushcfunction(L, &auto_persist<T>::persist);
+  lua_setfield(L, -2, "__persist");
+}
+
+template <typename T>
+auto
+set_auto_persist(lua_State *)
+  -> enable_if_t<!auto_persist_enabled<T>::value> {}
+
 //[ primer_default_metatable
 // minimalistic, do-nothing metatable
 template <typename T, typename ENABLE = void>
@@ -49,8 +71,33 @@ struct metatable {
     lua_setfield(L, -2, "__metatable");
     lua_pushcfunction(L, &primer::detail::common_gc_impl<T>);
     lua_setfield(L, -2, "__gc");
+    set_auto_persist<T>(L);
+    populate_bases(L, udata_all_bases<T>{});
+    populate_fields(L, udata_fields<T>{});
   }
 
+  // Types with bases get their methods
+  static void populate_bases(lua_State *, TypeList<>) {}
+
+  template <typename Bases>
+  static void populate_bases(lua_State * L, Bases) {
+    inherit_methods<Bases>::populate(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+
+  // Visitable structures also get access to their fields
+  template <typename F>
+  static auto populate_fields(lua_State * L, F) -> enable_if_t<F::value> {
+    F::push_index(L);
+    lua_setfield(L, -2, "__index");
+    F::push_newindex(L);
+    lua_setfield(L, -2, "__newindex");
+  }
+
+  template <typename F>
+  static auto populate_fields(lua_State *, F) -> enable_if_t<!F::value> {}
+
   static constexpr int value = 0;
 };
 //]
@@ -97,9 +144,13 @@ struct metatable<T, enable_if_t<detail::is_L_Reg_sequence<decltype(
     // Use auto in case we use an expanded reg type later.
     bool saw_gc_metamethod = false;
     bool saw_index_metamethod = false;
+    bool saw_newindex_metamethod = false;
     bool saw_metatable_metamethod = false;
+    bool saw_persist_metamethod = false;
     constexpr const char * gc_name = "__gc";
     constexpr const char * index_name = "__index";
+    constexpr const char * newindex_name = "__newindex";
+    constexpr const char * persist_name = "__persist";
     constexpr const char * metatable_name = "__metatable";
 
     // TODO: why can't we just use udata::metatable instead of metatable_seq?
@@ -118,12 +169,24 @@ struct metatable<T, enable_if_t<detail::is_L_Reg_sequence<decltype(
           if (0 == std::strcmp(name, index_name)) {
             saw_index_metamethod = true;
           }
+          if (0 == std::strcmp(name, newindex_name)) {
+            saw_newindex_metamethod = true;
+          }
+          if (0 == std::strcmp(name, persist_name)) {
+            saw_persist_metamethod = true;
+          }
           if (0 == std::strcmp(name, metatable_name)) {
             saw_metatable_metamethod = true;
           }
         }
       });
 
+    // If the trait asks for generated persistence, install it
+    if (!saw_persist_metamethod) { set_auto_persist<T>(L); }
+
+    // Methods of the bases which were not overridden
+    inherit_methods<udata_all_bases<T>>::populate(L);
+
     // If the user did not register __gc then it is potentially (likely) a
     // leak, so install a trivial guy which calls the dtor.
     // Rarely want anything besides this anyways.
@@ -143,9 +206,31 @@ struct metatable<T, enable_if_t<detail::is_L_Reg_sequence<decltype(
     }
 
     // Set the metatable to be its own __index table, unless user overrides it.
-    if (!saw_index_metamethod) {
+    // Visitable structures look up the methods in the metatable first, and
+    // then the fields.
+    populate_index(L, udata_fields<T>{}, saw_index_metamethod,
+                   saw_newindex_metamethod);
+  }
+
+  template <typename F>
+  static auto populate_index(lua_State * L, F, bool saw_index,
+                             bool saw_newindex) -> enable_if_t<F::value> {
+    if (!saw_index) {
+      F::push_index(L);
+      lua_setfield(L, -2, "__index");
+    }
+    if (!saw_newindex) {
+      F::push_newindex(L);
+      lua_setfield(L, -2, "__newindex");
+    }
+  }
+
+  template <typename F>
+  static auto populate_index(lua_State * L, F, bool saw_index, bool)
+    -> enable_if_t<!F::value> {
+    if (!saw_index) {
       lua_pushvalue(L, -1);
-      lua_setfield(L, -2, index_name);
+      lua_setfield(L, -2, "__index");
     }
   }
   //]
@@ -153,5 +238,45 @@ struct metatable<T, enable_if_t<detail::is_L_Reg_sequence<decltype(
   static constexpr int value = 2;
 };
 
+/***
+ * Copy the methods listed in the metatables of some userdata types into the
+ * table on top of the stack, skipping metamethods and names which are already
+ * present. Those methods can be called with the derived type, because reading
+ * a reference to a base also accepts derived types.
+ */
+template <typename... Bs>
+struct inherit_methods<TypeList<Bs...>> {
+  template <typename B>
+  static auto from_base(lua_State * L)
+    -> enable_if_t<metatable<B>::value == 2> {
+    using udata = primer::traits::userdata<B>;
+    using m_t = decltype(udata::metatable);
+    const auto & metatable_seq =
+      detail::is_L_Reg_sequence<m_t>::adapt(udata::metatable);
+
+    detail::iterate_L_Reg_sequence(
+      metatable_seq, [&](const char * name, lua_CFunction func) {
+        if (name && func && std::strncmp(name, "__", 2)) {
+          if (lua_getfield(L, -1, name) == LUA_TNIL) {
+            lua_pushcfunction(L, func);
+            lua_setfield(L, -3, name);
+          }
+          lua_pop(L, 1);
+        }
+      });
+  }
+
+  template <typename B>
+  static auto from_base(lua_State *)
+    -> enable_if_t<metatable<B>::value != 2> {}
+
+  static void populate(lua_State * L) {
+    PRIMER_ASSERT_TABLE(L);
+    PRIMER_ASSERT_STACK_NEUTRAL(L);
+    int dummy[] = {0, (from_base<Bs>(L), 0)...};
+    static_cast<void>(dummy);
+  }
+};
+
 } // end namesapce detail
 } // end namespace primer
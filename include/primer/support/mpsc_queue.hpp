@@ -0,0 +1,88 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * An intrusive, lock-free, multiple producer single consumer queue.
+ *
+ * This is the well-known design due to Dmitry Vyukov. Producers only perform
+ * one atomic exchange and one store. The consumer never blocks producers.
+ *
+ * The queue does not own its nodes, the user is responsible for allocating
+ * them and for disposing of them after they are popped.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <atomic>
+
+namespace primer {
+
+namespace detail {
+
+struct mpsc_node {
+  std::atomic<mpsc_node *> next{nullptr};
+};
+
+class mpsc_queue {
+  std::atomic<mpsc_node *> head_; // producers push here
+  mpsc_node * tail_;              // consumer pops here
+  mpsc_node stub_;
+
+public:
+  mpsc_queue() noexcept
+    : head_(&stub_)
+    , tail_(&stub_)
+    , stub_() {}
+
+  mpsc_queue(const mpsc_queue &) = delete;
+  mpsc_queue & operator=(const mpsc_queue &) = delete;
+
+  // Safe to call from any thread
+  void push(mpsc_node * n) noexcept {
+    n->next.store(nullptr, std::memory_order_relaxed);
+    mpsc_node * prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  // Consumer thread only. Returns nullptr if the queue is empty, or if a
+  // producer is in the middle of a push, in which case the node will become
+  // visible shortly.
+  mpsc_node * pop() noexcept {
+    mpsc_node * tail = tail_;
+    mpsc_node * next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (!next) { return nullptr; }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire)) { return nullptr; }
+    this->push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+  // Consumer thread only. Approximate, a push may be in progress.
+  bool empty() const noexcept {
+    return tail_ == &stub_
+           && !stub_.next.load(std::memory_order_acquire);
+  }
+};
+
+} // end namespace detail
+
+} // end namespace primer
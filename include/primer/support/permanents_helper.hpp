@@ -20,16 +20,36 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/lua.hpp>
 #include <primer/set_funcs.hpp>
 #include <primer/support/asserts.hpp>
+#include <primer/support/auto_persist.hpp>
 #include <primer/support/diagnostics.hpp>
 #include <primer/traits/userdata.hpp>
 
 namespace primer {
 namespace detail {
 
+// The reconstruct function of generated persistence, if enabled
+template <typename T>
+auto
+auto_persist_permanents(lua_State * L, bool reverse)
+  -> enable_if_t<auto_persist_enabled<T>::value> {
+  if (reverse) {
+    auto_persist<T>::populate_reverse(L);
+  } else {
+    auto_persist<T>::populate(L);
+  }
+}
+
+template <typename T>
+auto
+auto_persist_permanents(lua_State *, bool)
+  -> enable_if_t<!auto_persist_enabled<T>::value> {}
+
 template <typename T, typename ENABLE = void>
 struct permanents_helper {
-  static void populate(lua_State *) {}
-  static void populate_reverse(lua_State *) {}
+  static void populate(lua_State * L) { auto_persist_permanents<T>(L, false); }
+  static void populate_reverse(lua_State * L) {
+    auto_persist_permanents<T>(L, true);
+  }
   static constexpr int value = 0;
 };
 
@@ -40,10 +60,12 @@ struct permanents_helper<T,
 
   static void populate(lua_State * L) {
     primer::set_funcs(L, primer::traits::userdata<T>::permanents);
+    auto_persist_permanents<T>(L, false);
   }
 
   static void populate_reverse(lua_State * L) {
     primer::set_funcs_reverse(L, primer::traits::userdata<T>::permanents);
+    auto_persist_permanents<T>(L, true);
   }
 
   static constexpr int value = 1;
@@ -0,0 +1,104 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * A per-VM pool of finished lua threads, used by `primer::coroutine`.
+ *
+ * Creating a thread costs a `lua_newthread` allocation (the `lua_State` and
+ * its initial stack), and a finished thread is only reclaimed by the GC. When
+ * many short-lived coroutines are created, it is much cheaper to keep a few
+ * dead threads around and hand them out again.
+ *
+ * The pool is a table in the registry, (see `push_singleton`). Its array part
+ * is preallocated, so that returning a thread to the pool never allocates.
+ *
+ * A thread is only recycled if it ran to completion, i.e. its status is
+ * `LUA_OK` and it has no active call frames. Threads which yielded or raised
+ * an error are left for the GC, since lua 5.3 has no way to reset them.
+ *
+ * Like `lua_newthread`, a thread taken from the pool gets the hook which is
+ * currently set on the parent state. Recycling leaves the hook alone.
+ *
+ * The size of the pool is `PRIMER_COROUTINE_POOL_SIZE`. It is zero by default,
+ * which disables pooling. Lua code may still hold a reference to a finished
+ * thread, e.g. from `coroutine.running()`, and once the thread is reused that
+ * reference refers to the new coroutine. So pooling is only safe if scripts
+ * don't keep their threads around, and must be enabled explicitly.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+#include <primer/push_singleton.hpp>
+#include <primer/support/asserts.hpp>
+
+#ifndef PRIMER_COROUTINE_POOL_SIZE
+#define PRIMER_COROUTINE_POOL_SIZE 0
+#endif
+
+namespace primer {
+
+namespace detail {
+
+// Producer function for the pool table
+inline void
+make_thread_pool(lua_State * L) {
+  lua_createtable(L, PRIMER_COROUTINE_POOL_SIZE, 0);
+}
+
+// Pushes a fresh thread onto the stack, taking one from the pool if possible.
+// Returns a pointer to its stack.
+// Note: Can cause lua memory allocation failure
+inline lua_State *
+acquire_thread(lua_State * L) {
+#if PRIMER_COROUTINE_POOL_SIZE
+  push_singleton<&make_thread_pool>(L);
+  if (const auto n = lua_rawlen(L, -1)) {
+    lua_rawgeti(L, -1, static_cast<lua_Integer>(n));
+    lua_pushnil(L);
+    lua_rawseti(L, -3, static_cast<lua_Integer>(n));
+    lua_remove(L, -2);
+    PRIMER_ASSERT(lua_isthread(L, -1), "Thread pool was corrupted");
+    lua_State * T = lua_tothread(L, -1);
+    lua_sethook(T, lua_gethook(L), lua_gethookmask(L), lua_gethookcount(L));
+    return T;
+  }
+  lua_pop(L, 1);
+#endif
+  return lua_newthread(L);
+}
+
+// Returns a thread to the pool, if it ran to completion and there is room.
+// Note: Can cause lua memory allocation failure, if the pool does not exist yet
+inline void
+recycle_thread(lua_State * L, lua_State * T) {
+#if PRIMER_COROUTINE_POOL_SIZE
+  lua_Debug ar;
+  if (lua_status(T) != LUA_OK || lua_getstack(T, 0, &ar)) { return; }
+  if (!lua_checkstack(L, 2)) { return; }
+
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  lua_settop(T, 0);
+  push_singleton<&make_thread_pool>(L);
+  const auto n = lua_rawlen(L, -1);
+  if (n < PRIMER_COROUTINE_POOL_SIZE) {
+    lua_pushthread(T);
+    lua_xmove(T, L, 1);
+    lua_rawseti(L, -2, static_cast<lua_Integer>(n + 1));
+  }
+  lua_pop(L, 1);
+#else
+  static_cast<void>(L);
+  static_cast<void>(T);
+#endif
+}
+
+} // end namespace detail
+
+} // end namespace primer
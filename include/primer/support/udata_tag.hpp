@@ -0,0 +1,235 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Userdata created by primer carry a tag after the object, which identifies
+ * the type, so that checking the type of a userdata is a comparison of
+ * integers, without looking up the metatable in the registry.
+ *
+ * The tag is a hash of `udata::name`, which is also the key of the metatable.
+ * So types are identified just like by `luaL_testudata`, and the tag is the
+ * same in every process, which matters when eris persists the userdata
+ * literally.
+ *
+ * Before the tag, the block holds the tags of all the bases of the type, with
+ * the offset of each base subobject. So a userdata can be converted to any of
+ * its bases by scanning this short list, without walking any metatables.
+ * The layout of a block is
+ *
+ *   [ object ] [ base tag, offset ] ... [ number of bases ] [ tag ]
+ *
+ * The tag is checked together with the size of the block, and all the values
+ * read from a block are checked against its size, so that testing foreign
+ * userdata is safe.
+ *
+ * Userdata without a tag are still recognized by their metatable, like
+ * `luaL_testudata` does, with the object at the start of the block. These are
+ * created by `lua_newuserdata(L, sizeof(T))` and `luaL_setmetatable`, or were
+ * persisted before the tag was added. This is slower, and only done when the
+ * tag does not match.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/lua.hpp>
+#include <primer/detail/type_traits.hpp>
+#include <primer/detail/typelist.hpp>
+#include <primer/traits/userdata.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace primer {
+
+namespace detail {
+
+// FNV-1a
+inline std::uint64_t
+udata_name_hash(const char * str) noexcept {
+  std::uint64_t h = 14695981039346656037ull;
+  for (; *str; ++str) {
+    h ^= static_cast<unsigned char>(*str);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+inline std::uint64_t
+udata_word(const void * p, std::size_t offset) noexcept {
+  std::uint64_t result;
+  std::memcpy(&result, static_cast<const char *>(p) + offset, sizeof(result));
+  return result;
+}
+
+inline void
+udata_set_word(void * p, std::size_t offset, std::uint64_t w) noexcept {
+  std::memcpy(static_cast<char *>(p) + offset, &w, sizeof(w));
+}
+
+/***
+ * The bases declared in the userdata trait, and all of their bases
+ */
+template <typename T>
+struct bases_to_typelist;
+
+template <typename... Ts>
+struct bases_to_typelist<primer::bases<Ts...>> {
+  using type = TypeList<Ts...>;
+};
+
+template <typename T, typename ENABLE = void>
+struct udata_direct_bases {
+  using type = TypeList<>;
+};
+
+template <typename T>
+struct udata_direct_bases<
+  T, enable_if_t<std::is_same<typename primer::traits::userdata<T>::bases,
+                              typename primer::traits::userdata<T>::bases>::
+                   value>> {
+  using type =
+    typename bases_to_typelist<typename primer::traits::userdata<T>::bases>::
+      type;
+};
+
+template <typename L>
+struct udata_flatten_bases;
+
+template <>
+struct udata_flatten_bases<TypeList<>> {
+  using type = TypeList<>;
+};
+
+template <typename B, typename... Bs>
+struct udata_flatten_bases<TypeList<B, Bs...>> {
+  using type = typename Concat<
+    TypeList<B>,
+    typename Concat<typename udata_flatten_bases<
+                      typename udata_direct_bases<B>::type>::type,
+                    typename udata_flatten_bases<TypeList<Bs...>>::type>::
+      type>::type;
+};
+
+template <typename T>
+using udata_all_bases =
+  typename udata_flatten_bases<typename udata_direct_bases<T>::type>::type;
+
+template <typename T>
+struct udata_tag;
+
+// Writes the base table of T at `dest`
+template <typename T, typename L>
+struct udata_base_table;
+
+template <typename T>
+struct udata_base_table<T, TypeList<>> {
+  static void write(T *, void *) noexcept {}
+};
+
+template <typename T, typename... Bs>
+struct udata_base_table<T, TypeList<Bs...>> {
+  static void write(T * obj, void * dest) noexcept {
+    const std::uint64_t words[] = {
+      udata_tag<Bs>::value()...,
+      static_cast<std::uint64_t>(
+        static_cast<const char *>(static_cast<void *>(static_cast<Bs *>(obj)))
+        - static_cast<const char *>(static_cast<void *>(obj)))...};
+
+    constexpr std::size_t n = sizeof...(Bs);
+    for (std::size_t i = 0; i < n; ++i) {
+      udata_set_word(dest, 16 * i, words[i]);
+      udata_set_word(dest, 16 * i + 8, words[n + i]);
+    }
+  }
+};
+
+template <typename T>
+struct udata_tag {
+  using udata = primer::traits::userdata<T>;
+  using bases = udata_all_bases<T>;
+
+  // The base table follows the object, aligned
+  static constexpr std::size_t offset =
+    (sizeof(T) + alignof(std::uint64_t) - 1) / alignof(std::uint64_t)
+    * alignof(std::uint64_t);
+
+  static constexpr std::size_t block_size = offset + 16 * bases::size + 16;
+
+  static std::uint64_t value() noexcept {
+    static const std::uint64_t result = udata_name_hash(udata::name);
+    return result;
+  }
+
+  // Initialize the block of an object which was constructed in it
+  static void init(void * p) noexcept {
+    udata_base_table<T, bases>::write(static_cast<T *>(p),
+                                      static_cast<char *>(p) + offset);
+    udata_set_word(p, block_size - 16, bases::size);
+    udata_set_word(p, block_size - 8, value());
+  }
+
+  // Mark the block of a destroyed object
+  static void clear(void * p) noexcept { udata_set_word(p, block_size - 8, 0); }
+
+  // Only matches userdata of exactly this type
+  static T * test_exact(lua_State * L, int idx) noexcept {
+    void * p = lua_touserdata(L, idx);
+    if (p && lua_rawlen(L, idx) == block_size
+        && udata_word(p, block_size - 8) == value()) {
+      return static_cast<T *>(p);
+    }
+    return nullptr;
+  }
+
+  // Matches userdata without a tag, which have the metatable of this type
+  static T * test_untagged(lua_State * L, int idx) {
+    void * p = luaL_testudata(L, idx, udata::name);
+    if (p && lua_rawlen(L, idx) >= sizeof(T)) { return static_cast<T *>(p); }
+    return nullptr;
+  }
+
+  // Also matches userdata of types which list this type as a base, and
+  // userdata without a tag
+  static T * test(lua_State * L, int idx) {
+    if (T * result = test_tagged(L, idx)) { return result; }
+    return test_untagged(L, idx);
+  }
+
+  static T * test_tagged(lua_State * L, int idx) noexcept {
+    void * p = lua_touserdata(L, idx);
+    if (!p) { return nullptr; }
+
+    const std::size_t len = lua_rawlen(L, idx);
+    if (len < 16) { return nullptr; }
+
+    const std::uint64_t tag = udata_word(p, len - 8);
+    if (tag == value() && len == block_size) { return static_cast<T *>(p); }
+    if (tag == 0) { return nullptr; }
+
+    const std::uint64_t n = udata_word(p, len - 16);
+    if (n > (len - 16) / 16) { return nullptr; }
+
+    const std::size_t table = len - 16 - 16 * static_cast<std::size_t>(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (udata_word(p, table + 16 * i) == value()) {
+        const std::uint64_t off = udata_word(p, table + 16 * i + 8);
+        if (off > table || table - off < sizeof(T)) { return nullptr; }
+        return static_cast<T *>(
+          static_cast<void *>(static_cast<char *>(p) + off));
+      }
+    }
+    return nullptr;
+  }
+};
+
+} // end namespace detail
+
+} // end namespace primer
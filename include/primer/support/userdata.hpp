@@ -18,6 +18,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/support/asserts.hpp>
 #include <primer/support/diagnostics.hpp>
 #include <primer/support/metatable.hpp>
+#include <primer/support/udata_tag.hpp>
 #include <primer/support/userdata_common.hpp>
 
 #include <primer/traits/userdata.hpp>
@@ -38,26 +39,23 @@ template <typename T>
 struct udata_helper<T, enable_if_t<primer::detail::is_userdata<T>::value>> {
   using udata = primer::traits::userdata<T>;
 
-  // Based on impl of luaL_testudata
-  static T * test_udata(lua_State * L, int idx) {
-    PRIMER_ASSERT_STACK_NEUTRAL(L);
-    if (void * p = lua_touserdata(L, idx)) { /* value is a userdata? */
-      if (lua_getmetatable(L, idx)) {        /* does it have a metatable? */
-        primer::push_metatable<T>(L);        /* get correct metatable */
-        if (!lua_rawequal(L, -1, -2)) {      /* not the same? */
-          p = nullptr; /* value is a userdata with wrong metatable */
-        }
-        lua_pop(L, 2); /* remove both metatables */
-        return static_cast<T *>(p);
-      }
-    }
-    return nullptr; /* value is not a userdata with a metatable */
+  using tag = udata_tag<T>;
+
+  // Like luaL_testudata, but compares the tag instead of the metatable, and
+  // also accepts userdata of derived types
+  static T * test_udata(lua_State * L, int idx) { return tag::test(L, idx); }
+
+  // Allocate a block for the object and the tag, on top of the stack
+  static void * new_block(lua_State * L) {
+    return lua_newuserdata(L, tag::block_size);
   }
 
   // Based on impl of luaL_setmetatable
-  // Sets the top of the stack entry to this metatable
+  // Sets the top of the stack entry to this metatable, and sets the tag and
+  // the base table. This should happen after the object is constructed.
   static void set_metatable(lua_State * L) {
     PRIMER_ASSERT_STACK_NEUTRAL(L);
+    tag::init(lua_touserdata(L, -1));
     primer::push_metatable<T>(L);
     lua_setmetatable(L, -2);
   }
@@ -18,6 +18,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/lua.hpp>
 
 #include <primer/support/diagnostics.hpp>
+#include <primer/support/udata_tag.hpp>
 #include <primer/traits/userdata.hpp>
 #include <type_traits>
 
@@ -34,13 +35,17 @@ common_gc_impl(lua_State * L) noexcept {
 
   using udata = primer::traits::userdata<T>;
 
-  void * d = luaL_testudata(L, 1, udata::name);
+  T * d = udata_tag<T>::test_exact(L, 1);
+  const bool tagged = d;
+  if (!d) { d = udata_tag<T>::test_untagged(L, 1); }
   PRIMER_ASSERT(d, "garbage collection metamethod for userdata '"
                      << udata::name << "' called on object of type '"
                      << describe_lua_value(L, 1) << "'");
-  static_cast<T *>(d)->~T();
-  // Set metatable to nil. This prevents further access to the userdata, as
-  // can happen in some obscure corner cases
+  if (!d) { return 0; }
+  d->~T();
+  // Clear the tag and set metatable to nil. This prevents further access to
+  // the userdata, as can happen in some obscure corner cases
+  if (tagged) { udata_tag<T>::clear(d); }
   lua_pushnil(L);
   lua_setmetatable(L, 1);
   return 0;
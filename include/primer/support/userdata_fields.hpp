@@ -0,0 +1,213 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Field access for userdata types which are also visitable structures.
+ *
+ * The metamethods are closures over the metatable, which holds the methods,
+ * and a table mapping each field name to its index. Lua interns the field
+ * names, so finding the index is a single raw lookup, and then the field is
+ * read or written by an accessor generated for that index at compile time.
+ * Nothing is allocated, unless pushing or reading the field allocates.
+ *
+ * The methods take priority over the fields. Unknown keys give `nil`, like
+ * for the default `__index`, but assigning to an unknown key is an error.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/adapt.hpp>
+#include <primer/error.hpp>
+#include <primer/error_capture.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/push.hpp>
+#include <primer/read.hpp>
+#include <primer/result.hpp>
+
+#include <primer/detail/count.hpp>
+#include <primer/detail/max_int.hpp>
+#include <primer/detail/move_assign_noexcept.hpp>
+#include <primer/detail/type_traits.hpp>
+
+#include <primer/support/asserts.hpp>
+#include <primer/support/udata_tag.hpp>
+#include <primer/support/userdata_fields_fwd.hpp>
+
+#include <primer/traits/userdata.hpp>
+
+#include <visit_struct/visit_struct.hpp>
+
+#include <utility>
+
+namespace primer {
+
+namespace detail {
+
+// Accessors for the field at index `idx`
+template <typename T, int idx>
+struct udata_field {
+  using type = remove_cv_t<visit_struct::type_at<idx, T>>;
+
+  static void get(lua_State * L, T & t) {
+    primer::push(L, visit_struct::get<idx>(t));
+  }
+
+  static expected<void> set(lua_State * L, T & t, int index) noexcept {
+    auto result = primer::read<type>(L, index);
+    if (!result) {
+      return std::move(result.err().prepend_error_line(
+        "In field name '", visit_struct::get_name<idx, T>(), "',"));
+    }
+    detail::move_assign_noexcept(visit_struct::get<idx>(t),
+                                 std::move(*result));
+    return {};
+  }
+};
+
+template <typename T, typename I>
+struct udata_field_table;
+
+template <typename T, std::size_t... indices>
+struct udata_field_table<T, SizeList<indices...>> {
+  using getter_t = void (*)(lua_State *, T &);
+  using setter_t = expected<void> (*)(lua_State *, T &, int);
+
+  // The first entries are placeholders, so that the arrays are not empty
+  static getter_t getter(int i) {
+    static const getter_t getters[] = {
+      nullptr, &udata_field<T, static_cast<int>(indices)>::get...};
+    return getters[i + 1];
+  }
+
+  static setter_t setter(int i) {
+    static const setter_t setters[] = {
+      nullptr, &udata_field<T, static_cast<int>(indices)>::set...};
+    return setters[i + 1];
+  }
+
+  static constexpr int stack_space() {
+    return detail::max_int(
+      1,
+      stack_space_for_push<
+        typename udata_field<T, static_cast<int>(indices)>::type>()...);
+  }
+
+  // Push a table mapping the field names to their indices
+  static void push_names(lua_State * L) {
+    lua_createtable(L, 0, static_cast<int>(sizeof...(indices)));
+    int dummy[] = {0, (lua_pushinteger(L, static_cast<lua_Integer>(indices)),
+                       lua_setfield(L, -2, visit_struct::get_name<
+                                             static_cast<int>(indices), T>()),
+                       0)...};
+    static_cast<void>(dummy);
+  }
+};
+
+template <typename T>
+struct udata_fields<T,
+                    enable_if_t<visit_struct::traits::is_visitable<T>::value>> {
+  static constexpr bool value = true;
+
+  using udata = primer::traits::userdata<T>;
+  using table =
+    udata_field_table<T, Count_t<visit_struct::field_count<T>()>>;
+
+  // Look up the key on the stack at `key` in the field names upvalue. Returns
+  // the index of the field, or -1.
+  static int find_field(lua_State * L, int key) {
+    lua_pushvalue(L, key);
+    int result = -1;
+    if (lua_rawget(L, lua_upvalueindex(2)) == LUA_TNUMBER) {
+      result = static_cast<int>(lua_tointeger(L, -1));
+    }
+    lua_pop(L, 1);
+    return result;
+  }
+
+  // [ud] [key]
+  static primer::result index_impl(lua_State * L) {
+    lua_settop(L, 2);
+
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL) { return 1; }
+    lua_pop(L, 1);
+
+    int i = find_field(L, 2);
+    if (i < 0) {
+      lua_pushnil(L);
+      return 1;
+    }
+
+    T * t = udata_tag<T>::test(L, 1);
+    if (!t) { return primer::arg_error(L, 1, udata::name); }
+
+    constexpr int space = table::stack_space();
+    if (space > LUA_MINSTACK && !lua_checkstack(L, space)) {
+      return primer::error::insufficient_stack_space(space);
+    }
+    table::getter(i)(L, *t);
+    return 1;
+  }
+
+  // [ud] [key] [value]
+  static primer::result newindex_impl(lua_State * L) {
+    lua_settop(L, 3);
+
+    int i = find_field(L, 2);
+    if (i < 0) {
+      const char * name = udata::name;
+      return primer::error("Userdata '", name, "' has no field '",
+                           luaL_tolstring(L, 2, nullptr), "'");
+    }
+
+    T * t = udata_tag<T>::test(L, 1);
+    if (!t) { return primer::arg_error(L, 1, udata::name); }
+
+    auto ok = table::setter(i)(L, *t, 3);
+    if (!ok) { return std::move(ok.err()); }
+    return 0;
+  }
+
+  // [mt]
+  static void push_closure(lua_State * L, lua_CFunction f) {
+    lua_pushvalue(L, -1);
+    table::push_names(L);
+    lua_pushcclosure(L, f, 2);
+  }
+
+  static void push_index(lua_State * L) {
+    push_closure(L, PRIMER_ADAPT(&index_impl));
+  }
+
+  static void push_newindex(lua_State * L) {
+    push_closure(L, PRIMER_ADAPT(&newindex_impl));
+  }
+};
+
+} // end namespace detail
+
+//[ primer_set_udata_fields
+/// Install field access metamethods for a visitable userdata type into the
+/// metatable on top of the stack. The metatable is populated this way
+/// automatically, unless `__index` or `__newindex` are given explicitly, but
+/// a `metatable` function must call this itself.
+template <typename T>
+void
+set_udata_fields(lua_State * L) {
+  PRIMER_ASSERT_STACK_NEUTRAL(L);
+  PRIMER_ASSERT_TABLE(L);
+  detail::udata_fields<T>::push_index(L);
+  lua_setfield(L, -2, "__index");
+  detail::udata_fields<T>::push_newindex(L);
+  lua_setfield(L, -2, "__newindex");
+}
+//]
+
+} // end namespace primer
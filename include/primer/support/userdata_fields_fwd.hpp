@@ -0,0 +1,33 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * Trait which supplies `__index` and `__newindex` metamethods giving access to
+ * the fields of a userdata type. The primary template supplies nothing, the
+ * implementation for visitable structures is in `userdata_fields.hpp`.
+ *
+ * Should provide `static void push_index(lua_State *)` and
+ * `static void push_newindex(lua_State *)`, which expect the metatable on top
+ * of the stack and push the metamethods.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+namespace primer {
+
+namespace detail {
+
+template <typename T, typename ENABLE = void>
+struct udata_fields {
+  static constexpr bool value = false;
+};
+
+} // end namespace detail
+
+} // end namespace primer
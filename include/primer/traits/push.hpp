@@ -40,11 +40,11 @@ struct push<const char *> {
   static constexpr int stack_space_needed{1};
 };
 
-// Std-String
+// Std-String, may contain embedded zeros
 template <>
 struct push<std::string> {
   static void to_stack(lua_State * L, const std::string & str) {
-    push<const char *>::to_stack(L, str.c_str());
+    lua_pushlstring(L, str.data(), str.size());
   }
   static constexpr int stack_space_needed{1};
 };
@@ -7,6 +7,10 @@
 
 /***
  * How to read primitive values from the lua stack
+ *
+ * The specializations here are marked by `using primer_builtin = void;`. The
+ * fast path of PRIMER_ADAPT reads a type directly only if its trait has this
+ * marker, so that it never bypasses a full specialization by the user.
  */
 
 #include <primer/base.hpp>
@@ -25,6 +29,7 @@ PRIMER_ASSERT_FILESCOPE;
 #include <primer/support/types.hpp>
 #include <primer/userdata.hpp>
 
+#include <cstddef>
 #include <limits>
 #include <string>
 #include <type_traits>
@@ -43,17 +48,25 @@ struct read<const char *> {
     }
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 template <>
 struct read<std::string> {
   static expected<std::string> from_stack(lua_State * L, int idx) {
     PRIMER_TRY_BAD_ALLOC {
-      return read<const char *>::from_stack(L, idx).convert<std::string>();
+      if (lua_type(L, idx) == LUA_TSTRING) {
+        std::size_t len;
+        const char * str = lua_tolstring(L, idx, &len);
+        return std::string(str, len);
+      } else {
+        return primer::arg_error(L, idx, "string");
+      }
     }
     PRIMER_CATCH_BAD_ALLOC { return primer::error::bad_alloc(); }
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 template <>
@@ -66,6 +79,7 @@ struct read<bool> {
     }
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 // Integral types
@@ -84,6 +98,7 @@ struct signed_read_helper<T, enable_if_t<sizeof(T) >= sizeof(LUA_INTEGER)>> {
     }
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 // Narrowing, must do overflow check
@@ -102,6 +117,7 @@ struct signed_read_helper<T, enable_if_t<sizeof(T) < sizeof(LUA_INTEGER)>> {
     }
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 // When reading unsigned, must do 0 check
@@ -119,6 +135,7 @@ struct unsigned_read_helper {
     return maybe.template convert<unsigned_t>();
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 // Specialize read, using the helpers
@@ -154,6 +171,7 @@ struct read<T, enable_if_t<std::is_same<T, float>::value ||  //
     return result;
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 // Userdata
@@ -168,8 +186,8 @@ struct read_udata_impl {
     }
   }
 
-  static constexpr int stack_space_needed{1};
-  // have to push metatable to test, (happens implicitly in primer::test_udata)
+  static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 template <typename T>
@@ -190,6 +208,7 @@ struct read<nil_t> {
       return primer::arg_error(L, idx, "nil");
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 template <>
@@ -198,6 +217,7 @@ struct read<truthy> {
     return primer::truthy{static_cast<bool>(lua_toboolean(L, idx))};
   }
   static constexpr int stack_space_needed{0};
+  using primer_builtin = void;
 };
 
 template <>
@@ -206,8 +226,9 @@ struct read<stringy> {
     expected<stringy> result;
 
     if (luaL_callmeta(L, idx, "__tostring")) {
-      if (const char * str = lua_tostring(L, -1)) {
-        PRIMER_TRY_BAD_ALLOC { result = stringy{str}; }
+      std::size_t len;
+      if (const char * str = lua_tolstring(L, -1, &len)) {
+        PRIMER_TRY_BAD_ALLOC { result = stringy{std::string(str, len)}; }
         PRIMER_CATCH_BAD_ALLOC { result = primer::error::bad_alloc(); }
       } else {
         result =
@@ -218,7 +239,9 @@ struct read<stringy> {
     } else {
       switch (lua_type(L, idx)) {
         case LUA_TSTRING: {
-          PRIMER_TRY_BAD_ALLOC { result = stringy{lua_tostring(L, idx)}; }
+          std::size_t len;
+          const char * str = lua_tolstring(L, idx, &len);
+          PRIMER_TRY_BAD_ALLOC { result = stringy{std::string(str, len)}; }
           PRIMER_CATCH_BAD_ALLOC { result = primer::error::bad_alloc(); }
           break;
         }
@@ -20,4 +20,11 @@ template <typename T>
 struct userdata;
 
 } // end namespace traits
+
+//[ primer_userdata_bases
+/// List of base classes of a userdata type, given as the `bases` member of
+/// its userdata trait. Each base must also be a userdata type.
+template <typename... Ts>
+struct bases {};
+//]
 } // end namespace primer
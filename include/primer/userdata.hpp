@@ -36,7 +36,7 @@ auto
 push_udata(lua_State * L, Args &&... args)
   -> enable_if_t<detail::nothrow_newable<T, Args...>::value> {
   static_assert(detail::is_userdata<T>::value, "not a userdata type");
-  new (lua_newuserdata(L, sizeof(T))) T{std::forward<Args>(args)...};
+  new (detail::udata_helper<T>::new_block(L)) T{std::forward<Args>(args)...};
   detail::udata_helper<T>::set_metatable(L);
 }
 
@@ -46,7 +46,7 @@ auto
 push_udata(lua_State * L, Args &&... args)
   -> enable_if_t<!detail::nothrow_newable<T, Args...>::value> {
   static_assert(detail::is_userdata<T>::value, "not a userdata type");
-  void * storage = lua_newuserdata(L, sizeof(T));
+  void * storage = detail::udata_helper<T>::new_block(L);
 
   PRIMER_TRY {
     new (storage) T{std::forward<Args>(args)...};
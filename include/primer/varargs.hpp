@@ -0,0 +1,153 @@
+//  (C) Copyright 2015 - 2018 Christopher Beck
+
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+/***
+ * `primer::varargs` is a view of the remaining arguments of a callback.
+ *
+ * When used as the last parameter of a function passed to PRIMER_ADAPT, it
+ * refers to all the arguments at and after its position. No values are read
+ * until they are requested, and nothing is allocated.
+ *
+ * The view refers to stack positions, so it is only valid during the call.
+ */
+
+#include <primer/base.hpp>
+
+PRIMER_ASSERT_FILESCOPE;
+
+#include <primer/detail/fast_read.hpp>
+#include <primer/expected.hpp>
+#include <primer/lua.hpp>
+#include <primer/primer_fwd.hpp>
+#include <primer/read.hpp>
+
+#include <cstddef>
+#include <iterator>
+
+namespace primer {
+
+//[ primer_varargs
+class varargs {
+  lua_State * L_;
+  int first_;
+  int count_;
+
+public:
+  /*<< One argument >>*/
+  class value {
+    lua_State * L_;
+    int idx_;
+
+  public:
+    value(lua_State * L, int idx) noexcept
+      : L_(L)
+      , idx_(idx) {}
+
+    /*<< The stack index of the argument >>*/
+    int index() const noexcept { return idx_; }
+    /*<< The lua type, as from `lua_type` >>*/
+    int type() const noexcept { return lua_type(L_, idx_); }
+    /*<< Read the argument, using `primer::read` >>*/
+    template <typename T>
+    expected<T> as() const {
+      return primer::read<T>(L_, idx_);
+    }
+  };
+
+  /*<< An input iterator over the arguments, producing `value` objects >>*/
+  class iterator {
+    lua_State * L_;
+    int idx_;
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = varargs::value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = varargs::value;
+
+    iterator(lua_State * L, int idx) noexcept
+      : L_(L)
+      , idx_(idx) {}
+
+    value operator*() const noexcept { return value{L_, idx_}; }
+    iterator & operator++() noexcept {
+      ++idx_;
+      return *this;
+    }
+    iterator operator++(int) noexcept {
+      iterator result{*this};
+      ++idx_;
+      return result;
+    }
+    difference_type operator-(const iterator & o) const noexcept {
+      return idx_ - o.idx_;
+    }
+    bool operator==(const iterator & o) const noexcept {
+      return idx_ == o.idx_;
+    }
+    bool operator!=(const iterator & o) const noexcept {
+      return idx_ != o.idx_;
+    }
+  };
+
+  /*<< View of the values from stack index `first` to the top >>*/
+  varargs(lua_State * L, int first) noexcept;
+
+  std::size_t size() const noexcept {
+    return static_cast<std::size_t>(count_);
+  }
+  bool empty() const noexcept { return !count_; }
+
+  /*<< Unchecked access to the `i`'th value, counting from zero >>*/
+  value operator[](std::size_t i) const noexcept {
+    return value{L_, first_ + static_cast<int>(i)};
+  }
+
+  /*<< Read the `i`'th value. Reading past the end behaves like reading nil.
+       >>*/
+  template <typename T>
+  expected<T> get(std::size_t i) const {
+    return (*this)[i].template as<T>();
+  }
+
+  iterator begin() const noexcept { return iterator{L_, first_}; }
+  iterator end() const noexcept { return iterator{L_, first_ + count_}; }
+};
+//]
+
+inline varargs::varargs(lua_State * L, int first) noexcept
+  : L_(L)
+  , first_(lua_absindex(L, first))
+  , count_(0) {
+  int top = lua_gettop(L);
+  if (first_ <= top) { count_ = top - first_ + 1; }
+}
+
+namespace traits {
+
+template <>
+struct read<varargs> {
+  static expected<varargs> from_stack(lua_State * L, int idx) {
+    return varargs{L, idx};
+  }
+  static constexpr int stack_space_needed{0};  using primer_builtin = void;
+};
+
+} // end namespace traits
+
+namespace detail {
+
+template <>
+struct fast_read<varargs> : fast_read_base<varargs, lua_type_any> {
+  static varargs get(lua_State * L, int idx) noexcept {
+    return varargs{L, idx};
+  }
+};
+
+} // end namespace detail
+} // end namespace primer
@@ -1,12 +1,21 @@
 #include <primer/api.hpp>
+#include <primer/api/worker_pool.hpp>
 #include <primer/primer.hpp>
 #include <primer/std/vector.hpp>
 
 #include "test_harness/g_inspector.hpp"
 #include "test_harness/test_harness.hpp"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <future>
 #include <initializer_list>
 #include <iostream>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <vector>
 
 struct test_api_one : primer::api::persistable<test_api_one> {
   lua_raii L;
@@ -551,6 +560,384 @@ UNIT_TEST(sandboxed_libs) {
   TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
 }
 
+/***
+ * Test lazily created globals
+ */
+
+struct test_api_lazy : primer::api::base<test_api_lazy> {
+  lua_raii L_;
+
+  using libs_t = primer::api::lazy_libraries<
+    primer::api::lua_base_lib_sandboxed, primer::api::lua_table_lib,
+    primer::api::lua_math_lib_sandboxed, primer::api::lua_string_lib,
+    primer::api::lua_coroutine_lib>;
+
+  API_FEATURE(libs_t, libs_);
+
+  NEW_LUA_CALLBACK(twice, "doubles a number")
+  (lua_State *, int i)->std::tuple<int> { return std::make_tuple(2 * i); }
+
+  USE_LUA_CALLBACK(help, "get help for a built-in function",
+                   &primer::api::intf_help_impl);
+
+  API_FEATURE(primer::api::lazy_callbacks<test_api_lazy>, cb_);
+
+  test_api_lazy()
+    : L_()
+    , cb_(this) {
+    this->initialize_api(L_);
+  }
+
+  std::string save() {
+    std::string result;
+    this->persist(L_, result);
+    return result;
+  }
+
+  void restore(const std::string & buffer) { this->unpersist(L_, buffer); }
+};
+
+// Same features, created eagerly
+struct test_api_eager : primer::api::base<test_api_eager> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+
+  NEW_LUA_CALLBACK(twice, "doubles a number")
+  (lua_State *, int i)->std::tuple<int> { return std::make_tuple(2 * i); }
+
+  USE_LUA_CALLBACK(help, "get help for a built-in function",
+                   &primer::api::intf_help_impl);
+
+  API_FEATURE(primer::api::callbacks, cb_);
+
+  test_api_eager()
+    : L_()
+    , cb_(this) {
+    this->initialize_api(L_);
+  }
+};
+
+namespace {
+
+int
+lua_memory_bytes(lua_State * L) {
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  return lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+bool
+is_lib_loaded(lua_State * L, const char * name) {
+  luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+  bool result = lua_getfield(L, -1, name) != LUA_TNIL;
+  lua_pop(L, 2);
+  return result;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(lazy_globals) {
+  const char * check_untouched =
+    "assert(rawget(_G, 'twice') == nil)             \n"
+    "assert(rawget(_G, 'table') == nil)             \n"
+    "assert(('abc'):upper() == 'ABC')               \n";
+
+  const char * script =
+    "assert(twice(4) == 8)                          \n"
+    "assert(rawget(_G, 'twice') == twice)           \n"
+    "assert(help(twice) == 'doubles a number')      \n"
+    "assert(string.rep('a', 3) == 'aaa')            \n"
+    "assert(table.unpack({5}) == 5)                 \n"
+    "assert(not math.random)                        \n"
+    "assert(undefined_global == nil)                \n";
+
+  std::string buffer;
+  {
+    test_api_lazy a;
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, check_untouched));
+    buffer = a.save();
+    TEST(!is_lib_loaded(L, "table"), "persisting should not open libraries");
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    CHECK_STACK(L, 0);
+  }
+
+  // Globals which were not created before persisting are still available
+  {
+    test_api_lazy a;
+    a.restore(buffer);
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, check_untouched));
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    buffer = a.save();
+  }
+
+  // And those which were created are persisted normally
+  {
+    test_api_lazy a;
+    a.restore(buffer);
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, "assert(rawget(_G, 'twice'))"));
+    TEST(is_lib_loaded(L, "table"), "expected table library to be restored");
+    TEST(!is_lib_loaded(L, "coroutine"), "expected coroutine library unused");
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    buffer = a.save();
+    CHECK_STACK(L, 0);
+  }
+
+  // Libraries which were opened are still persisted after a restore
+  {
+    test_api_lazy a;
+    a.restore(buffer);
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, "assert(rawget(_G, 'table'))"));
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    buffer = a.save();
+    CHECK_STACK(L, 0);
+  }
+
+  // A fresh VM uses less memory than one with all globals created eagerly
+  {
+    test_api_lazy lazy;
+    test_api_eager eager;
+    TEST(lua_memory_bytes(lazy.L_) < lua_memory_bytes(eager.L_),
+         "expected memory savings");
+  }
+}
+
+// With the package library, `require` is available at once, and opens the
+// lazy libraries
+struct test_api_lazy_package : primer::api::base<test_api_lazy_package> {
+  lua_raii L_;
+
+  using libs_t = primer::api::lazy_libraries<
+    primer::api::lua_base_lib, primer::api::lua_package_lib,
+    primer::api::lua_table_lib, primer::api::lua_math_lib>;
+
+  API_FEATURE(libs_t, libs_);
+
+  test_api_lazy_package()
+    : L_() {
+    this->initialize_api(L_);
+  }
+};
+
+UNIT_TEST(lazy_libraries_require) {
+  test_api_lazy_package a;
+  lua_State * L = a.L_;
+
+  const char * script =
+    "assert(rawget(_G, 'require'))                  \n"
+    "assert(rawget(_G, 'math') == nil)              \n"
+    "local m = require 'math'                       \n"
+    "assert(m.floor(2.5) == 2)                      \n"
+    "assert(math == m)                              \n"
+    "assert(table == require 'table')               \n"
+    "assert(not pcall(require, 'undefined_module')) \n";
+  TEST_LUA_OK(L, luaL_dostring(L, script));
+  CHECK_STACK(L, 0);
+}
+
+// A lazy global loader keeps an __index which was already installed
+UNIT_TEST(lazy_globals_chain) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+
+  const char * strict =
+    "setmetatable(_G, {__index = function(t, k)                \n"
+    "  if k == 'fallback' then return 5 end                    \n"
+    "  error('undefined global ' .. k)                         \n"
+    "end})                                                     \n";
+  TEST_LUA_OK(L, luaL_dostring(L, strict));
+
+  lua_CFunction loader = [](lua_State * L) -> int {
+    const char * name = lua_tostring(L, 1);
+    if (name && !std::strcmp(name, "lazy")) {
+      lua_pushinteger(L, 7);
+      return 1;
+    }
+    return 0;
+  };
+  primer::api::add_lazy_global_loader(L, loader);
+  CHECK_STACK(L, 0);
+
+  const char * script =
+    "assert(lazy == 7)                                         \n"
+    "assert(rawget(_G, 'lazy') == 7)                           \n"
+    "assert(fallback == 5)                                     \n"
+    "assert(rawget(_G, 'fallback') == nil)                     \n"
+    "assert(not pcall(function() return undefined_global end)) \n";
+  TEST_LUA_OK(L, luaL_dostring(L, script));
+  CHECK_STACK(L, 0);
+}
+
+/***
+ * Test callbacks placed in a module table
+ */
+
+struct test_api_module : primer::api::base<test_api_module> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+
+  NEW_LUA_CALLBACK(twice, "doubles a number")
+  (lua_State *, int i)->std::tuple<int> { return std::make_tuple(2 * i); }
+
+  NEW_LUA_CALLBACK(add, "adds two numbers")
+  (lua_State *, int i, int j)->std::tuple<int> {
+    return std::make_tuple(i + j);
+  }
+
+  USE_LUA_CALLBACK(help, "get help for a built-in function",
+                   &primer::api::intf_help_impl);
+
+  API_FEATURE(primer::api::callbacks, cb_);
+
+  test_api_module()
+    : L_()
+    , cb_(this, "game") {
+    this->initialize_api(L_);
+  }
+
+  std::string save() {
+    std::string result;
+    this->persist(L_, result);
+    return result;
+  }
+
+  void restore(const std::string & buffer) { this->unpersist(L_, buffer); }
+};
+
+UNIT_TEST(callbacks_module) {
+  const char * script =
+    "assert(twice == nil)                                    \n"
+    "assert(type(game) == 'table')                           \n"
+    "assert(game.twice(4) == 8)                              \n"
+    "assert(game.add(4, 5) == 9)                             \n"
+    "assert(game.help(game.add) == 'adds two numbers')       \n"
+    "local n = 0                                             \n"
+    "for k, v in pairs(game) do n = n + 1 end                \n"
+    "assert(n == 3)                                          \n";
+
+  std::string buffer;
+  {
+    test_api_module a;
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    CHECK_STACK(L, 0);
+    buffer = a.save();
+  }
+
+  {
+    test_api_module a;
+    a.restore(buffer);
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, script));
+    CHECK_STACK(L, 0);
+  }
+}
+
+/***
+ * Test several objects dispatched to through upvalues
+ */
+
+class counter {
+  const char * name_;
+
+  std::tuple<int> intf_bump(lua_State *, int n) {
+    count += n;
+    return std::make_tuple(count);
+  }
+
+  static std::array<luaL_Reg, 1> get_funcs() {
+    return {{
+      luaL_Reg{"bump", PRIMER_ADAPT_UPVALUE(counter, &counter::intf_bump)},
+    }};
+  }
+
+public:
+  int count = 0;
+
+  explicit counter(const char * name)
+    : name_(name) {}
+
+  void on_init(lua_State * L) {
+    lua_newtable(L);
+    primer::set_bound_funcs(L, this, name_, get_funcs());
+    lua_setglobal(L, name_);
+  }
+
+  void on_persist_table(lua_State * L) {
+    primer::set_bound_funcs_prefix_reverse(L, name_, get_funcs());
+  }
+
+  void on_unpersist_table(lua_State * L) {
+    primer::set_bound_funcs_prefix(L, name_, get_funcs());
+  }
+};
+
+struct test_api_counters : primer::api::base<test_api_counters> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+  API_FEATURE(counter, a_);
+  API_FEATURE(counter, b_);
+
+  test_api_counters()
+    : L_()
+    , a_("a")
+    , b_("b") {
+    this->initialize_api(L_);
+  }
+
+  std::string save() {
+    std::string result;
+    this->persist(L_, result);
+    return result;
+  }
+
+  void restore(const std::string & buffer) { this->unpersist(L_, buffer); }
+};
+
+UNIT_TEST(upvalue_dispatch) {
+  std::string buffer;
+  {
+    test_api_counters t;
+    lua_State * L = t.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, "assert(a.bump(2) == 2)           \n"
+                                    "assert(a.bump(3) == 5)           \n"
+                                    "assert(b.bump(1) == 1)           \n"
+                                    "bump_a = a.bump                  \n"));
+    TEST_EQ(5, t.a_.count);
+    TEST_EQ(1, t.b_.count);
+    CHECK_STACK(L, 0);
+    buffer = t.save();
+  }
+
+  // The closures dispatch to the objects of the api which restored them
+  {
+    test_api_counters t;
+    t.restore(buffer);
+    lua_State * L = t.L_;
+
+    TEST_LUA_OK(L, luaL_dostring(L, "assert(bump_a(4) == 4)           \n"
+                                    "assert(bump_a == a.bump)         \n"
+                                    "assert(b.bump(7) == 7)           \n"));
+    TEST_EQ(4, t.a_.count);
+    TEST_EQ(7, t.b_.count);
+    CHECK_STACK(L, 0);
+  }
+}
+
 struct test_api_six : primer::api::base<test_api_six> {
   lua_raii L_;
 
@@ -717,6 +1104,291 @@ UNIT_TEST(api_vfs) {
 }
 //]
 
+struct test_api_sched : primer::api::base<test_api_sched> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+  API_FEATURE(primer::api::scheduler, sched_);
+
+  test_api_sched()
+    : L_() {
+    this->initialize_api(L_);
+  }
+
+  std::string save() {
+    std::string result;
+    this->persist(L_, result);
+    return result;
+  }
+
+  void restore(const std::string & buffer) { this->unpersist(L_, buffer); }
+
+  std::string get_log() {
+    lua_getglobal(L_, "get_log");
+    lua_call(L_, 0, 1);
+    std::string result = lua_tostring(L_, -1);
+    lua_pop(L_, 1);
+    return result;
+  }
+};
+
+UNIT_TEST(api_scheduler) {
+  using clock = primer::api::scheduler::clock;
+  using std::chrono::milliseconds;
+
+  const char * script =
+    "log = {}                                                              \n"
+    "function get_log() return table.concat(log, ',') end                  \n"
+    "function worker(name)                                                 \n"
+    "  table.insert(log, name .. ':start')                                 \n"
+    "  next_frame()                                                        \n"
+    "  table.insert(log, name .. ':frame')                                 \n"
+    "  sleep(1)                                                            \n"
+    "  table.insert(log, name .. ':slept')                                 \n"
+    "  wait('go')                                                          \n"
+    "  table.insert(log, name .. ':go')                                    \n"
+    "end                                                                   \n"
+    "spawn(worker, 'a')                                                    \n";
+
+  std::string buffer;
+  const clock::time_point t0{};
+  const clock::duration budget = milliseconds(100);
+
+  {
+    test_api_sched a;
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+    TEST_EQ(1, a.sched_.size());
+
+    TEST_EQ(1, a.sched_.tick(L, t0, budget));
+    TEST_EQ("a:start", a.get_log());
+    TEST_EQ(1, a.sched_.tick(L, t0, budget));
+    TEST_EQ("a:start,a:frame", a.get_log());
+    TEST_EQ(0, a.sched_.tick(L, t0 + milliseconds(500), budget));
+    TEST_EQ(1, a.sched_.tick(L, t0 + milliseconds(1000), budget));
+    TEST_EQ("a:start,a:frame,a:slept", a.get_log());
+    TEST_EQ(0, a.sched_.tick(L, t0 + milliseconds(2000), budget));
+
+    a.sched_.signal("go");
+    TEST_EQ(1, a.sched_.tick(L, t0 + milliseconds(2000), budget));
+    TEST_EQ("a:start,a:frame,a:slept,a:go", a.get_log());
+    TEST_EQ(0, a.sched_.size());
+    TEST_EQ(0, a.sched_.pop_errors().size());
+
+    // Errors are collected and the task is dropped
+    TEST_LUA_OK(L, luaL_loadstring(L, "spawn(function() error('boom') end)"));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+    TEST_EQ(1, a.sched_.tick(L, t0, budget));
+    auto errors = a.sched_.pop_errors();
+    TEST_EQ(1, errors.size());
+    TEST(errors[0].str().find("boom") != std::string::npos,
+         "unexpected error: " << errors[0].str());
+    TEST_EQ(0, a.sched_.size());
+
+    // Spawning from C++, with a budget that runs only one batch
+    TEST_LUA_OK(L, luaL_loadstring(L, "return function(x) while true do "
+                                      "coroutine.yield() end end"));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 1, 0));
+    primer::bound_function f{L};
+    for (int i = 0; i < 100; ++i) {
+      TEST_EXPECTED(a.sched_.spawn(f, i));
+    }
+    TEST_EQ(100, a.sched_.size());
+    a.sched_.set_batch_size(10);
+    TEST_EQ(10, a.sched_.tick(L, t0, clock::duration::zero()));
+    TEST_EQ(90, a.sched_.ready_count());
+    TEST_EQ(100, a.sched_.tick(L, t0, budget));
+    TEST_EQ(100, a.sched_.size());
+    TEST_EQ(0, a.sched_.pop_errors().size());
+  }
+
+  // A task budget keeps an infinite loop from starving the other tasks
+  {
+    test_api_sched a;
+    lua_State * L = a.L_;
+
+    primer::budget b;
+    b.instructions = 10000;
+    a.sched_.set_task_budget(b);
+
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+    TEST_LUA_OK(L, luaL_loadstring(L, "spawn(function() while true do end "
+                                      "end) spawn(worker, 'b')"));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+
+    TEST_EQ(3, a.sched_.tick(L, t0, budget));
+    TEST_EQ("a:start,b:start", a.get_log());
+    TEST_EQ(3, a.sched_.tick(L, t0, budget));
+    TEST_EQ("a:start,b:start,a:frame,b:frame", a.get_log());
+    TEST_EQ(3, a.sched_.size());
+    TEST_EQ(0, a.sched_.pop_errors().size());
+  }
+
+  // Sleeping and waiting tasks survive persistence
+  {
+    test_api_sched a;
+    lua_State * L = a.L_;
+
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+    TEST_LUA_OK(L, luaL_loadstring(L, "spawn(worker, 'b')"));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+
+    TEST_EQ(2, a.sched_.tick(L, t0, budget));
+    TEST_EQ(2, a.sched_.tick(L, t0, budget));
+    TEST_EQ(2, a.sched_.tick(L, t0 + milliseconds(1000), budget));
+    TEST_EQ("a:start,b:start,a:frame,b:frame,a:slept,b:slept", a.get_log());
+
+    buffer = a.save();
+  }
+
+  {
+    test_api_sched a;
+    lua_State * L = a.L_;
+
+    a.restore(buffer);
+    TEST_EQ(2, a.sched_.size());
+    TEST_EQ(0, a.sched_.tick(L, t0, budget));
+    a.sched_.signal("go");
+    TEST_EQ(2, a.sched_.tick(L, t0, budget));
+    TEST_EQ("a:start,b:start,a:frame,b:frame,a:slept,b:slept,a:go,b:go",
+            a.get_log());
+    TEST_EQ(0, a.sched_.size());
+    TEST_EQ(0, a.sched_.pop_errors().size());
+  }
+}
+
+struct test_api_worker : primer::api::base<test_api_worker> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+
+  static std::atomic<int> count;
+
+  test_api_worker()
+    : L_() {
+    this->initialize_api(L_);
+
+    const char * script =
+      "function square(x) return x * x end                                   \n"
+      "function fail() error('failed') end                                   \n"
+      "function slow(n)                                                      \n"
+      "  local s = 0                                                         \n"
+      "  for i = 1, n do s = s + i end                                       \n"
+      "  return vm_id                                                        \n"
+      "end                                                                  \n";
+    luaL_dostring(L_, script);
+    lua_pushinteger(L_, ++count);
+    lua_setglobal(L_, "vm_id");
+  }
+
+  static lua_State * get_state(test_api_worker & w) { return w.L_; }
+};
+
+std::atomic<int> test_api_worker::count{0};
+
+UNIT_TEST(api_worker_pool) {
+  test_api_worker::count = 0;
+
+  std::vector<std::future<primer::expected<int>>> results;
+  {
+    primer::api::worker_pool<test_api_worker> pool{&test_api_worker::get_state,
+                                                   4};
+    TEST_EQ(4, pool.size());
+
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 2) {
+        results.push_back(pool.post<int>("square", i));
+      } else {
+        results.push_back(pool.post_shard<int>(i, "square", i));
+      }
+    }
+    for (int i = 0; i < 1000; ++i) {
+      auto r = results[i].get();
+      TEST_EXPECTED(r);
+      TEST_EQ(i * i, *r);
+    }
+    TEST_EQ(4, test_api_worker::count);
+
+    // Errors
+    auto e1 = pool.post("fail").get();
+    TEST(!e1, "expected an error");
+    TEST(e1.err().str().find("failed") != std::string::npos,
+         "unexpected error: " << e1.err().str());
+
+    auto e2 = pool.post<int>("no_such_function").get();
+    TEST(!e2, "expected an error");
+
+    auto e3 = pool.post<std::string>("fail").get();
+    TEST(!e3, "expected an error");
+
+    // Jobs which are all keyed to one worker are stolen by the others
+    std::vector<std::future<primer::expected<int>>> slow;
+    for (int i = 0; i < 200; ++i) {
+      slow.push_back(pool.post_shard<int>(0, "slow", 20000));
+    }
+    std::set<int> ids;
+    for (auto & f : slow) {
+      auto r = f.get();
+      TEST_EXPECTED(r);
+      ids.insert(*r);
+    }
+    TEST(ids.size() > 1, "expected work stealing");
+
+    // Outstanding jobs are finished when the pool is destroyed
+    results.clear();
+    for (int i = 0; i < 100; ++i) {
+      results.push_back(pool.post<int>("square", i));
+    }
+  }
+
+  for (int i = 0; i < 100; ++i) {
+    auto r = results[i].get();
+    TEST_EXPECTED(r);
+    TEST_EQ(i * i, *r);
+  }
+}
+
+// A VM whose constructor throws, on the third worker
+struct test_api_worker_throws : test_api_worker {
+  test_api_worker_throws() {
+    lua_getglobal(L_, "vm_id");
+    lua_Integer id = lua_tointeger(L_, -1);
+    lua_pop(L_, 1);
+    if (id == 3) { throw std::runtime_error{"no vm"}; }
+  }
+};
+
+UNIT_TEST(api_worker_pool_start) {
+  // Pinned workers
+  test_api_worker::count = 0;
+  {
+    primer::api::worker_pool<test_api_worker> pool{&test_api_worker::get_state,
+                                                   2, true};
+    TEST_EQ(2, test_api_worker::count);
+    auto r = pool.post<int>("square", 3).get();
+    TEST_EXPECTED(r);
+    TEST_EQ(9, *r);
+  }
+
+  // A VM constructor which throws is reported by the pool constructor
+  test_api_worker::count = 0;
+  bool thrown = false;
+  try {
+    primer::api::worker_pool<test_api_worker_throws> pool{
+      [](test_api_worker_throws & w) { return test_api_worker::get_state(w); },
+      4};
+  } catch (std::runtime_error & e) {
+    thrown = true;
+    TEST_EQ(std::string{"no vm"}, e.what());
+  }
+  TEST(thrown, "expected the pool constructor to throw");
+  TEST_EQ(4, test_api_worker::count);
+}
+
 int
 main() {
   conf::log_conf();
@@ -0,0 +1,269 @@
+#include <primer/await.hpp>
+#include <primer/primer.hpp>
+
+#include "test_harness/test_harness.hpp"
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <vector>
+
+/***
+ * A minimal eager C++20 coroutine type, for testing
+ */
+
+struct task {
+  struct promise_type {
+    std::exception_ptr error_;
+
+    task get_return_object() {
+      return task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { error_ = std::current_exception(); }
+  };
+
+  std::coroutine_handle<promise_type> handle_;
+
+  explicit task(std::coroutine_handle<promise_type> h)
+    : handle_(h) {}
+  task(const task &) = delete;
+  ~task() { handle_.destroy(); }
+
+  // Check if the coroutine finished, rethrowing any test failure
+  bool done() const {
+    if (handle_.promise().error_) {
+      std::rethrow_exception(handle_.promise().error_);
+    }
+    return handle_.done();
+  }
+};
+
+/***
+ * Test stepping through a coroutine
+ */
+
+task
+step_through(primer::coroutine & c, std::vector<int> & out) {
+  auto r = co_await primer::step(c, 1);
+  TEST_EXPECTED(r);
+  TEST(!r->done, "expected a yield");
+  TEST_EQ(1, r->values.size());
+  out.push_back(*r->values[0].as<int>());
+
+  r = co_await primer::step(c, 5);
+  TEST_EXPECTED(r);
+  TEST(!r->done, "expected a yield");
+  out.push_back(*r->values[0].as<int>());
+
+  r = co_await primer::step(c, 10);
+  TEST_EXPECTED(r);
+  TEST(r->done, "expected a return");
+  out.push_back(*r->values[0].as<int>());
+
+  r = co_await primer::step(c);
+  TEST(!r, "expected an error from a dead coroutine");
+}
+
+UNIT_TEST(await_step) {
+  lua_raii L;
+
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "return function(x)                                  \n"
+    "  local y = coroutine.yield(x + 1)                  \n"
+    "  local z = coroutine.yield(x + y)                  \n"
+    "  return x + y + z                                  \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function f{L};
+  primer::coroutine c{f};
+
+  std::vector<int> out;
+  task t = step_through(c, out);
+  TEST(t.done(), "expected coroutine to finish without suspending");
+  TEST_EQ(3, out.size());
+  TEST_EQ(2, out[0]);
+  TEST_EQ(6, out[1]);
+  TEST_EQ(16, out[2]);
+  CHECK_STACK(L, 0);
+}
+
+/***
+ * Test lua awaiting C++ operations
+ */
+
+std::vector<primer::async_op> pending_ops;
+
+primer::result
+request(lua_State * L, int) {
+  primer::async_op op;
+  pending_ops.push_back(op);
+  primer::push(L, op);
+  return 1;
+}
+
+primer::result
+fetch(lua_State * L, int x) {
+  request(L, x);
+  return primer::yield{1};
+}
+
+task
+call_script(const primer::bound_function & f, int x,
+            primer::expected<primer::lua_ref_seq> & out) {
+  out = co_await primer::async_call(f, x);
+}
+
+UNIT_TEST(await_async_op) {
+  lua_raii L;
+
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+  lua_pushcfunction(L, PRIMER_ADAPT(&request));
+  lua_setglobal(L, "request");
+  lua_pushcfunction(L, PRIMER_ADAPT(&fetch));
+  lua_setglobal(L, "fetch");
+
+  const char * script =
+    "return function(x)                                  \n"
+    "  local a = fetch(x)                                \n"
+    "  local b, err = coroutine.yield(request(x + 1))    \n"
+    "  local c, msg = fetch(x + 2)                       \n"
+    "  return a + b, err, c, msg                         \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function f{L};
+
+  primer::expected<primer::lua_ref_seq> out{primer::error{"not set"}};
+  pending_ops.clear();
+
+  task t = call_script(f, 3, out);
+  TEST(!t.done(), "expected suspension");
+  TEST_EQ(1, pending_ops.size());
+
+  // Completing an operation resumes lua, which waits on the next one
+  lua_pushinteger(L, 10);
+  pending_ops[0].complete(primer::pop_n(L, 1));
+  TEST(!t.done(), "expected suspension");
+  TEST_EQ(2, pending_ops.size());
+
+  // An operation yielded explicitly by the script, and completed with an error
+  // Errors are returned to the script as `nil, message`
+  lua_pushinteger(L, 20);
+  lua_pushstring(L, "no error");
+  pending_ops[1].complete(primer::pop_n(L, 2));
+  TEST(!t.done(), "expected suspension");
+  TEST_EQ(3, pending_ops.size());
+
+  pending_ops[2].fail(primer::error{"service unavailable"});
+  TEST(t.done(), "expected completion");
+
+  TEST_EXPECTED(out);
+  TEST_EQ(4, out->size());
+  TEST_EQ(30, *out->at(0).as<int>());
+  TEST_EQ("no error", *out->at(1).as<std::string>());
+  TEST(!out->at(2).as<int>(), "expected nil");
+  TEST_EQ("service unavailable", *out->at(3).as<std::string>());
+  CHECK_STACK(L, 0);
+
+  // An operation which is already complete does not suspend
+  {
+    primer::async_op op;
+    lua_pushinteger(L, 7);
+    op.complete(primer::pop_n(L, 1));
+    primer::push(L, op);
+    lua_setglobal(L, "done_op");
+
+    const char * script2 = "return coroutine.yield(done_op) + ...";
+    TEST_LUA_OK(L, luaL_loadstring(L, script2));
+    primer::bound_function g{L};
+
+    task t2 = call_script(g, 5, out);
+    TEST(t2.done(), "expected completion");
+    TEST_EXPECTED(out);
+    TEST_EQ(12, *out->at(0).as<int>());
+  }
+
+  pending_ops.clear();
+}
+
+// Destroying a suspended C++ coroutine detaches it from the operation
+UNIT_TEST(await_destroyed) {
+  lua_raii L;
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&fetch));
+  lua_setglobal(L, "fetch");
+
+  const char * script = "return fetch(...)";
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  primer::bound_function f{L};
+
+  primer::expected<primer::lua_ref_seq> out{primer::error{"not set"}};
+  pending_ops.clear();
+
+  {
+    task t = call_script(f, 1, out);
+    TEST(!t.done(), "expected suspension");
+    TEST_EQ(1, pending_ops.size());
+  }
+
+  lua_pushinteger(L, 10);
+  pending_ops[0].complete(primer::pop_n(L, 1));
+  TEST(pending_ops[0].ready(), "expected the operation to complete");
+  TEST_EQ("not set", out.err().str());
+  CHECK_STACK(L, 0);
+
+  pending_ops.clear();
+}
+
+// A second script waiting for the same operation gets an error, and does not
+// detach the first one
+UNIT_TEST(await_shared_op) {
+  lua_raii L;
+
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  primer::async_op op;
+  primer::push(L, op);
+  lua_setglobal(L, "shared_op");
+
+  const char * script = "return coroutine.yield(shared_op)";
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  primer::bound_function f{L};
+
+  primer::expected<primer::lua_ref_seq> out1{primer::error{"not set"}};
+  primer::expected<primer::lua_ref_seq> out2{primer::error{"not set"}};
+
+  task t1 = call_script(f, 1, out1);
+  TEST(!t1.done(), "expected suspension");
+  {
+    task t2 = call_script(f, 2, out2);
+    TEST(t2.done(), "expected the second waiter to be rejected");
+    TEST(!out2, "expected an error");
+    TEST_EQ("async_op is already awaited", out2.err().str());
+  }
+
+  lua_pushinteger(L, 10);
+  op.complete(primer::pop_n(L, 1));
+  TEST(t1.done(), "expected completion");
+  TEST_EXPECTED(out1);
+  TEST_EQ(10, *out1->at(0).as<int>());
+  CHECK_STACK(L, 0);
+}
+
+int
+main() {
+  conf::log_conf();
+
+  std::cout << "Await tests:" << std::endl;
+  return test_registrar::run_tests();
+}
@@ -0,0 +1,273 @@
+#include <primer/api.hpp>
+#include <primer/primer.hpp>
+
+#include "test_harness/test_harness.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifndef PRIMER_CALL_STATS
+#error "This test should be compiled with PRIMER_CALL_STATS"
+#endif
+
+namespace {
+
+const primer::call_stats *
+find_stats(const std::vector<primer::call_stats> & v, const std::string & n) {
+  for (const auto & s : v) {
+    if (s.name == n) { return &s; }
+  }
+  return nullptr;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(call_stats_buckets) {
+  using primer::detail::call_stats_bucket;
+  using primer::detail::call_stats_bucket_lower;
+
+  for (std::uint64_t i = 0; i < 16; ++i) {
+    TEST_EQ(i, call_stats_bucket(i));
+    TEST_EQ(i, call_stats_bucket_lower(i));
+  }
+
+  for (std::size_t i = 0; i + 1 < primer::detail::call_stats_buckets; ++i) {
+    std::uint64_t lo = call_stats_bucket_lower(i);
+    std::uint64_t hi = call_stats_bucket_lower(i + 1);
+    TEST(lo < hi, "bucket bounds out of order at " << i);
+    TEST_EQ(i, call_stats_bucket(lo));
+    TEST_EQ(i, call_stats_bucket(hi - 1));
+  }
+
+  TEST_EQ(primer::detail::call_stats_buckets - 1,
+          call_stats_bucket(~std::uint64_t(0)));
+}
+
+UNIT_TEST(call_stats_bound_function) {
+  lua_raii L;
+  primer::call_stats::reset();
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "return function(x)                                  \n"
+    "  if x < 0 then error('negative') end               \n"
+    "  local s = 0                                       \n"
+    "  for i = 1, x do s = s + i end                     \n"
+    "  return s                                          \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function f{L};
+  const std::string name = f.debug_string();
+
+  for (int i = 0; i < 100; ++i) {
+    TEST_EXPECTED(f.call_one_ret(i));
+  }
+  TEST(!f.call_no_ret(-1), "expected an error");
+
+  // Calls from another thread are merged with the rest
+  std::thread t{[&]() {
+    for (int i = 0; i < 10; ++i) {
+      f.call_no_ret(1000000);
+    }
+  }};
+  t.join();
+
+  auto v = primer::call_stats::snapshot();
+  const primer::call_stats * s = find_stats(v, name);
+  TEST(s, "missing stats for " << name);
+  TEST_EQ(111, s->calls);
+  TEST_EQ(1, s->errors);
+  TEST_EQ(primer::detail::call_stats_buckets, s->histogram.size());
+
+  // The ten slow calls are in the top decile
+  auto p50 = s->percentile(0.5);
+  auto p99 = s->percentile(0.99);
+  TEST(p50 <= p99, "percentiles out of order");
+  TEST(p99 > 10 * p50, "expected slow calls to dominate p99");
+
+  // Coroutine resumes are counted under the same function
+  {
+    const char * script2 =
+      "return function(x)                                \n"
+      "  coroutine.yield(x)                              \n"
+      "  return x                                        \n"
+      "end                                               \n";
+    // Use a different chunk name, otherwise both functions have the same
+    // debug string
+    TEST_LUA_OK(L, luaL_loadbuffer(L, script2, std::strlen(script2), "=co"));
+    TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+    primer::bound_function g{L};
+
+    primer::coroutine c{g};
+    TEST_EXPECTED(c.call_one_ret(5));
+    TEST_EXPECTED(c.call_one_ret());
+    TEST(!c, "expected the coroutine to finish");
+
+    v = primer::call_stats::snapshot();
+    s = find_stats(v, g.debug_string());
+    TEST(s, "missing stats for " << g.debug_string());
+    TEST_EQ(2, s->calls);
+    TEST_EQ(0, s->errors);
+  }
+
+  primer::call_stats::reset();
+  v = primer::call_stats::snapshot();
+  s = find_stats(v, name);
+  TEST(s, "missing stats for " << name);
+  TEST_EQ(0, s->calls);
+  CHECK_STACK(L, 0);
+}
+
+// Functions which are collected do not pass their statistics on to new
+// functions at the same address, and do not stay in the cache.
+UNIT_TEST(call_stats_collected_functions) {
+  lua_raii L;
+  primer::call_stats::reset();
+
+  // Each closure made by `make(i)` has the same size, and a different name
+  const int n = 50;
+  std::string script = "return function(i)\n";
+  for (int i = 0; i < n; ++i) {
+    script += "if i == " + std::to_string(i);
+    script += " then return function() end end\n";
+  }
+  script += "end\n";
+  TEST_LUA_OK(L, luaL_loadstring(L, script.c_str()));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function make{L};
+
+  std::vector<std::string> names;
+  for (int i = 0; i < n; ++i) {
+    auto r = make.call_one_ret(i);
+    TEST_EXPECTED(r);
+    r->push(L);
+    r->reset();
+    {
+      primer::bound_function f{L};
+      names.push_back(f.debug_string());
+      TEST_EXPECTED(f.call_no_ret());
+    }
+    lua_gc(L, LUA_GCCOLLECT, 0);
+  }
+
+  auto v = primer::call_stats::snapshot();
+  for (const std::string & name : names) {
+    const primer::call_stats * s = find_stats(v, name);
+    TEST(s, "missing stats for " << name);
+    TEST_EQ(1, s->calls);
+  }
+
+  // Only `make` is left in the cache
+  primer::push_singleton<&primer::detail::call_stats_cache>(L);
+  int count = 0;
+  lua_pushnil(L);
+  while (lua_next(L, -2)) {
+    lua_pop(L, 1);
+    ++count;
+  }
+  lua_pop(L, 1);
+  TEST_EQ(1, count);
+  CHECK_STACK(L, 0);
+}
+
+namespace {
+
+int
+raise_impl(lua_State * L) {
+  return luaL_error(L, "raised");
+}
+
+} // end anonymous namespace
+
+struct stats_api : primer::api::base<stats_api> {
+  lua_raii L_;
+
+  API_FEATURE(primer::api::sandboxed_basic_libraries, libs_);
+
+  NEW_LUA_CALLBACK(twice, "doubles a number")
+  (lua_State *, int i)->std::tuple<int> { return std::make_tuple(2 * i); }
+
+  NEW_LUA_CALLBACK(fail, "always fails")(lua_State *)->primer::result {
+    return primer::error{"failed"};
+  }
+
+  USE_LUA_CALLBACK(raise, "calls lua_error", &raise_impl);
+
+  USE_LUA_CALLBACK(stats, "get callback statistics",
+                   &primer::api::intf_callback_stats_impl);
+
+  API_FEATURE(primer::api::callbacks, cb_);
+
+  stats_api()
+    : L_()
+    , cb_(this) {
+    this->initialize_api(L_);
+  }
+};
+
+UNIT_TEST(call_stats_callbacks) {
+  primer::call_stats::reset();
+  stats_api a;
+  lua_State * L = a.L_;
+
+  const char * script =
+    "for i = 1, 10 do assert(twice(i) == 2 * i) end          \n"
+    "assert(not pcall(twice, 'x'))                           \n"
+    "assert(not pcall(fail))                                 \n"
+    "local s = stats()                                       \n"
+    "assert(s.twice.calls == 11)                             \n"
+    "assert(s.twice.errors == 1)                             \n"
+    "assert(s.twice.time >= 0)                               \n"
+    "assert(s.fail.calls == 1)                               \n"
+    "assert(s.fail.errors == 1)                              \n"
+    "assert(not pcall(raise))                                \n"
+    "assert(not pcall(raise))                                \n"
+    "s = stats()                                             \n"
+    "assert(s.raise.calls == 2)                              \n"
+    "assert(s.raise.errors == 2)                             \n"
+    "assert(s.twice.errors == 1)                             \n";
+
+  TEST_LUA_OK(L, luaL_dostring(L, script));
+  CHECK_STACK(L, 0);
+
+  auto v = primer::call_stats::callback_snapshot();
+  const primer::call_stats * s = find_stats(v, "twice");
+  TEST(s, "missing stats for twice");
+  TEST_EQ(11, s->calls);
+  TEST_EQ(1, s->errors);
+  TEST(s->total.count() > 0, "expected nonzero total time");
+
+  s = find_stats(v, "stats");
+  TEST(s, "missing stats for stats");
+  TEST_EQ(2, s->calls);
+  TEST_EQ(0, s->errors);
+
+  // Callbacks are not mixed up with lua functions
+  TEST(!find_stats(primer::call_stats::snapshot(), "twice"),
+       "unexpected stats for twice");
+
+  primer::call_stats::reset();
+  v = primer::call_stats::callback_snapshot();
+  s = find_stats(v, "twice");
+  TEST(s, "missing stats for twice");
+  TEST_EQ(0, s->calls);
+  TEST_EQ(0, s->total.count());
+}
+
+int
+main() {
+  conf::log_conf();
+
+  std::cout << "Call stats tests:" << std::endl;
+  return test_registrar::run_tests();
+}
@@ -1,9 +1,18 @@
+#include <primer/completion.hpp>
+#include <primer/executor.hpp>
 #include <primer/primer.hpp>
 
 #include "test_harness/test_harness.hpp"
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 using uint = unsigned int;
 
@@ -246,6 +255,98 @@ UNIT_TEST(simple_type_safety) {
   test_type_safety<int>(L, primer::nil_t{}, __LINE__);
 }
 
+// Test the messages of preformatted errors
+UNIT_TEST(error_messages) {
+  lua_raii L;
+
+  // The expected string is copied, and need not outlive the error
+  {
+    std::string expected{"a very long and dynamically allocated name"};
+    primer::error e = primer::error::unexpected_value(expected.c_str(), "nil");
+    expected.assign(expected.size(), 'x');
+    expected.clear();
+    expected.shrink_to_fit();
+    TEST_EQ("Expected a very long and dynamically allocated name found: 'nil'",
+            e.str());
+  }
+
+  // Argument errors are formatted once, even when read from several threads
+  {
+    lua_pushboolean(L, true);
+    const primer::error e = primer::arg_error(L, -1, "string");
+    lua_pop(L, 1);
+    const char * a = nullptr;
+    const char * b = nullptr;
+    std::thread t1{[&]() { a = e.what(); }};
+    std::thread t2{[&]() { b = e.what(); }};
+    t1.join();
+    t2.join();
+    TEST(a == b, "expected the same text");
+    TEST_EQ("Expected string found: 'boolean'", std::string{a});
+  }
+
+  lua_pushnil(L);
+  primer::error e1 = primer::arg_error(L, -1, "integer");
+  lua_pop(L, 1);
+  TEST_EQ(std::string{"Expected integer found: 'nil'"}, e1.what());
+
+  // Copies format independently, and the message is stable
+  primer::error e2 = e1;
+  TEST_EQ(e1.str(), e2.str());
+  TEST_EQ(e1.what(), e1.what());
+
+  TEST_EQ("Integer overflow occurred: -5000000000",
+          primer::error::integer_overflow(-5000000000LL).str());
+  TEST_EQ("Insufficient stack space: needed 12",
+          primer::error::insufficient_stack_space(12).str());
+  TEST_EQ("Expected nonnegative integer found: '-1'",
+          primer::error::unexpected_value("nonnegative integer", -1).str());
+  TEST_EQ("Expected foo found: 'bar'",
+          primer::error::unexpected_value("foo", std::string{"bar"}).str());
+
+  // Adding context to one copy does not change the other
+  e1.prepend_error_line("In index [1],");
+  TEST_EQ("In index [1],\nExpected integer found: 'nil'", e1.str());
+  TEST_EQ("Expected integer found: 'nil'", e2.str());
+
+  // Context lines are kept in order, and copies are independent
+  e2 = e1;
+  e1.prepend_error_line("In field '", "foo", "',");
+  TEST_EQ("In field 'foo',\nIn index [1],\nExpected integer found: 'nil'",
+          e1.str());
+  TEST_EQ("In index [1],\nExpected integer found: 'nil'", e2.str());
+
+  // Context lines are rendered outermost first, for every kind of message
+  {
+    primer::error e = primer::error::cant_lock_vm();
+    for (int i = 1; i <= 3; ++i) {
+      e.prepend_error_line("Level ", i);
+    }
+    TEST_EQ("Level 3\nLevel 2\nLevel 1\ncouldn't access the lua VM", e.str());
+    TEST_EQ(e.str(), std::string{e.what()});
+
+    primer::error d{"inner"};
+    std::string expected = "inner";
+    for (int i = 0; i < 1000; ++i) {
+      d.prepend_error_line(i);
+      expected = std::to_string(i) + "\n" + expected;
+    }
+    TEST_EQ(expected, d.str());
+    TEST_EQ(expected, std::string{d.what()});
+
+    // Adding a line after the text was requested
+    d.prepend_error_line("top");
+    TEST_EQ("top\n" + expected, std::string{d.what()});
+  }
+
+  // Reading a value of the wrong type
+  lua_pushboolean(L, true);
+  auto r = primer::read<int>(L, -1);
+  lua_pop(L, 1);
+  TEST(!r, "expected an error");
+  TEST_EQ("Expected integer found: 'boolean'", r.err().str());
+}
+
 /***
  * Test primer adapt
  */
@@ -499,6 +600,359 @@ UNIT_TEST(adapt_three) {
   CHECK_STACK(L, 0);
 }
 
+namespace {
+
+unsigned test_fast_u;
+double test_fast_d;
+std::string test_fast_s;
+bool test_fast_b;
+
+primer::result
+test_func_fast(lua_State *, unsigned u, double d, const char * s, bool b,
+               primer::nil_t) {
+  test_fast_u = u;
+  test_fast_d = d;
+  test_fast_s = s;
+  test_fast_b = b;
+  return 0;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(adapt_fast_read) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&test_func_fast));
+  lua_setglobal(L, "f");
+
+  // All argument types match, fast path
+  TEST_LUA_OK(L, luaL_dostring(L, "f(3, 2.5, 'a', true)"));
+  TEST_EQ(test_fast_u, 3u);
+  TEST_EQ(test_fast_d, 2.5);
+  TEST_EQ(test_fast_s, "a");
+  TEST_EQ(test_fast_b, true);
+
+  // Numeric strings are still converted, by the slow path
+  TEST_LUA_OK(L, luaL_dostring(L, "f(4, '1.5', 'b', false, nil)"));
+  TEST_EQ(test_fast_u, 4u);
+  TEST_EQ(test_fast_d, 1.5);
+  TEST_EQ(test_fast_s, "b");
+  TEST_EQ(test_fast_b, false);
+
+  // Errors give the same messages as before
+  const char * script = "local ok, err = pcall(f, ...); return err";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  lua_pushinteger(L, -1);
+  lua_pushnumber(L, 1.5);
+  lua_pushstring(L, "c");
+  lua_pushboolean(L, true);
+  TEST_LUA_OK(L, lua_pcall(L, 4, 1, 0));
+  TEST_EQ(std::string{"Expected nonnegative integer found: '-1'"},
+          lua_tostring(L, -1));
+  lua_pop(L, 1);
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  lua_pushnumber(L, 1.5);
+  lua_pushnumber(L, 1.5);
+  lua_pushstring(L, "c");
+  lua_pushboolean(L, true);
+  TEST_LUA_OK(L, lua_pcall(L, 4, 1, 0));
+  TEST_EQ(std::string{"Expected integer found: 'number'"},
+          lua_tostring(L, -1));
+  lua_pop(L, 1);
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  lua_pushinteger(L, 1);
+  lua_pushnumber(L, 1.5);
+  lua_pushstring(L, "c");
+  lua_pushboolean(L, true);
+  lua_pushinteger(L, 5);
+  TEST_LUA_OK(L, lua_pcall(L, 5, 1, 0));
+  TEST_EQ(std::string{"Expected nil found: 'number'"}, lua_tostring(L, -1));
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+// A full specialization by the user replaces primer's trait, also in the fast
+// path of PRIMER_ADAPT
+namespace primer {
+namespace traits {
+
+template <>
+struct read<long double> {
+  static expected<long double> from_stack(lua_State * L, int idx) {
+    if (lua_isnumber(L, idx)) { return 10 * lua_tonumber(L, idx); }
+    return primer::arg_error(L, idx, "number");
+  }
+  static constexpr int stack_space_needed{0};
+};
+
+} // end namespace traits
+} // end namespace primer
+
+static_assert(primer::detail::fast_read<double>::enabled, "");
+static_assert(!primer::detail::fast_read<long double>::enabled, "");
+
+namespace {
+
+long double test_fast_ld;
+
+primer::result
+test_func_user_read(lua_State *, long double d) {
+  test_fast_ld = d;
+  return 0;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(adapt_fast_read_user_trait) {
+  lua_raii L;
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&test_func_user_read));
+  lua_pushnumber(L, 2);
+  TEST_LUA_OK(L, lua_pcall(L, 1, 0, 0));
+  TEST_EQ(test_fast_ld, 20);
+  CHECK_STACK(L, 0);
+}
+
+namespace {
+
+primer::result
+overload_int(lua_State * L, int i) {
+  primer::push(L, std::string{"int"});
+  primer::push(L, i);
+  return 2;
+}
+
+primer::result
+overload_number(lua_State * L, double d) {
+  primer::push(L, std::string{"number"});
+  primer::push(L, d);
+  return 2;
+}
+
+primer::result
+overload_string_bool(lua_State * L, std::string s, bool b) {
+  primer::push(L, std::string{"string_bool"});
+  primer::push(L, b ? s : std::string{});
+  return 2;
+}
+
+primer::result
+overload_optional(lua_State * L, const char * s, primer::nil_t) {
+  primer::push(L, std::string{"optional"});
+  primer::push(L, std::string{s});
+  return 2;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(adapt_overloads) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT_OVERLOADS(&overload_int, &overload_number,
+                                              &overload_string_bool,
+                                              &overload_optional));
+  lua_setglobal(L, "f");
+
+  auto check = [&](const char * script, const char * which,
+                   const char * value) {
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 2, 0));
+    TEST_EQ(std::string{which}, lua_tostring(L, -2));
+    TEST_EQ(std::string{value}, lua_tostring(L, -1));
+    lua_pop(L, 2);
+    CHECK_STACK(L, 0);
+  };
+
+  check("return f(5)", "int", "5");
+  check("return f(1.5)", "number", "1.5");
+  check("return f('a', true)", "string_bool", "a");
+  check("return f('b')", "optional", "b");
+  check("return f('c', nil)", "optional", "c");
+  check("return f(5, nil)", "int", "5");
+  check("return f(1.5, nil, nil, nil)", "number", "1.5");
+  check("return f('a', true, nil)", "string_bool", "a");
+
+  check("local ok, e = pcall(f); return tostring(ok), e", "false",
+        "No overload matches arguments ()");
+  check("local ok, e = pcall(f, 1, 2); return tostring(ok), e", "false",
+        "No overload matches arguments (number, number)");
+  check("local ok, e = pcall(f, {}, 'a'); return tostring(ok), e", "false",
+        "No overload matches arguments (table, string)");
+  check("local ok, e = pcall(f, 1, nil, nil, 2); return tostring(ok), e",
+        "false", "No overload matches arguments (number, nil, nil, number)");
+}
+
+namespace {
+
+primer::result
+sum_rest(lua_State * L, std::string label, primer::varargs rest) {
+  int total = 0;
+  for (auto v : rest) {
+    auto i = v.as<int>();
+    if (!i) { return i.err().prepend_error_line("In argument ", v.index()); }
+    total += *i;
+  }
+  primer::push(L, label + ":" + std::to_string(rest.size()) + ":"
+                    + std::to_string(total));
+  return 1;
+}
+
+primer::result
+count_rest(lua_State * L, primer::varargs rest) {
+  TEST_EQ(rest.empty(), rest.begin() == rest.end());
+  TEST_EQ(rest.size(), static_cast<std::size_t>(
+                        std::distance(rest.begin(), rest.end())));
+  if (!rest.empty()) { TEST_EQ(LUA_TNUMBER, rest[0].type()); }
+  TEST(!rest.get<int>(rest.size()), "past the end should read as nil");
+  primer::push(L, static_cast<int>(rest.size()));
+  return 1;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(adapt_varargs) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&sum_rest));
+  lua_setglobal(L, "sum");
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&count_rest));
+  lua_setglobal(L, "count");
+
+  lua_pushcfunction(L, PRIMER_ADAPT_OVERLOADS(&overload_int, &sum_rest));
+  lua_setglobal(L, "over");
+
+  auto check = [&](const char * script, const char * expected) {
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 1, 0));
+    TEST_EQ(std::string{expected}, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    CHECK_STACK(L, 0);
+  };
+
+  check("return sum('a')", "a:0:0");
+  check("return sum('b', 1, 2, 3)", "b:3:6");
+  check("return tostring(count())", "0");
+  check("return tostring(count(4, 5))", "2");
+  check("local ok, e = pcall(sum, 'c', 1, 'x'); return e",
+        "In argument 3\nExpected integer found: 'string'");
+
+  check("return tostring(select(2, over(7)))", "7");
+  check("return over('d', 4, 5)", "d:2:9");
+  check("return over('d', 4, 5, 6)", "d:3:15");
+}
+
+namespace {
+
+std::tuple<int, std::string, bool>
+return_tuple(lua_State *, int i) {
+  return std::make_tuple(i + 1, std::to_string(i), i > 0);
+}
+
+std::pair<std::string, int>
+return_pair(lua_State *, std::string s) {
+  return {s + s, static_cast<int>(s.size())};
+}
+
+primer::expected<std::tuple<int, int>>
+return_expected(lua_State *, int a, int b) {
+  if (!b) { return primer::error{"division by zero"}; }
+  return std::make_tuple(a / b, a % b);
+}
+
+std::tuple<>
+return_nothing(lua_State *) {
+  return {};
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(adapt_return_values) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&return_tuple));
+  lua_setglobal(L, "tup");
+  lua_pushcfunction(L, PRIMER_ADAPT(&return_pair));
+  lua_setglobal(L, "pair");
+  lua_pushcfunction(L, PRIMER_ADAPT(&return_expected));
+  lua_setglobal(L, "divmod");
+  lua_pushcfunction(L, PRIMER_ADAPT(&return_nothing));
+  lua_setglobal(L, "nothing");
+
+  auto check = [&](const char * script, const char * expected) {
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 1, 0));
+    TEST_EQ(std::string{expected}, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    CHECK_STACK(L, 0);
+  };
+
+  check("local a, b, c = tup(4); return tostring(a) .. b .. tostring(c)",
+        "54true");
+  check("local a, b = pair('xy'); return a .. tostring(b)", "xyxy2");
+  check("local q, r = divmod(7, 2); return tostring(q) .. tostring(r)", "31");
+  check("local ok, e = pcall(divmod, 1, 0); return e", "division by zero");
+  check("return tostring(select('#', nothing()))", "0");
+  check("local ok, e = pcall(tup, 'a'); return tostring(ok)", "false");
+}
+
+UNIT_TEST(adapt_compact) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT_COMPACT(&test_func_fast));
+  lua_setglobal(L, "f");
+  lua_pushcfunction(L, PRIMER_ADAPT_COMPACT(&return_tuple));
+  lua_setglobal(L, "tup");
+  lua_pushcfunction(L, PRIMER_ADAPT_COMPACT(&return_expected));
+  lua_setglobal(L, "divmod");
+  lua_pushcfunction(L, PRIMER_ADAPT_COMPACT(&return_nothing));
+  lua_setglobal(L, "nothing");
+
+  TEST_LUA_OK(L, luaL_dostring(L, "f(3, '2.5', 'a', true)"));
+  TEST_EQ(test_fast_u, 3u);
+  TEST_EQ(test_fast_d, 2.5);
+  TEST_EQ(test_fast_s, "a");
+  TEST_EQ(test_fast_b, true);
+
+  auto check = [&](const char * script, const char * expected) {
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 1, 0));
+    TEST_EQ(std::string{expected}, lua_tostring(L, -1));
+    lua_pop(L, 1);
+    CHECK_STACK(L, 0);
+  };
+
+  // Same results and error messages as PRIMER_ADAPT
+  check("local ok, e = pcall(f, -1, 1.5, 'c', true); return e",
+        "Expected nonnegative integer found: '-1'");
+  check("local ok, e = pcall(f, 1, 1.5, 'c', true, 5); return e",
+        "Expected nil found: 'number'");
+  check("local a, b, c = tup(4); return tostring(a) .. b .. tostring(c)",
+        "54true");
+  check("local q, r = divmod(7, 2); return tostring(q) .. tostring(r)", "31");
+  check("local ok, e = pcall(divmod, 1, 0); return e", "division by zero");
+  check("return tostring(select('#', nothing()))", "0");
+}
+
 #define WEAK_REF_TEST(X)                                                       \
   TEST(X, "Unexpected value for lua_state_ref. line: " << __LINE__)
 
@@ -804,6 +1258,70 @@ UNIT_TEST(primer_call) {
   CHECK_STACK(L, 0);
 }
 
+// Test the builtin error handlers
+UNIT_TEST(traceback_modes) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "local function inner() error('boom') end          \n"
+    "function outer() inner() end                      \n";
+  TEST_LUA_OK(L, luaL_loadbuffer(L, script, std::strlen(script), "=test"));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 0));
+
+  lua_getglobal(L, "outer");
+  primer::bound_function outer{L};
+  CHECK_STACK(L, 0);
+
+  TEST_EQ("", primer::last_traceback(L));
+
+  // Full
+  {
+    auto r = outer.call_no_ret();
+    TEST(!r, "expected an error");
+    TEST(r.err().str().find("stack traceback:") != std::string::npos,
+         "expected a traceback: " << r.err().str());
+  }
+
+  // None
+  {
+    primer::set_traceback_mode(L, primer::traceback_mode::none);
+    auto r = outer.call_no_ret();
+    TEST(!r, "expected an error");
+    TEST(r.err().str().find("traceback") == std::string::npos,
+         "unexpected traceback: " << r.err().str());
+    TEST(r.err().str().find("test:1: boom") != std::string::npos,
+         "unexpected message: " << r.err().str());
+    TEST_EQ("", primer::last_traceback(L));
+  }
+
+  // Compact
+  {
+    primer::set_traceback_mode(L, primer::traceback_mode::compact);
+    auto r = outer.call_no_ret();
+    TEST(!r, "expected an error");
+    TEST(r.err().str().find("traceback") == std::string::npos,
+         "unexpected traceback: " << r.err().str());
+    TEST_EQ("stack traceback:\n"
+            "\t[C]: in ?\n"
+            "\ttest:1: in function <test:1>\n"
+            "\ttest:2: in function <test:2>",
+            primer::last_traceback(L));
+  }
+
+  // Back to full
+  {
+    primer::set_traceback_mode(L, primer::traceback_mode::full);
+    auto r = outer.call_no_ret();
+    TEST(!r, "expected an error");
+    TEST(r.err().str().find("stack traceback:") != std::string::npos,
+         "expected a traceback: " << r.err().str());
+  }
+  CHECK_STACK(L, 0);
+}
+
 UNIT_TEST(primer_resume) {
   lua_raii L;
 
@@ -1187,6 +1705,492 @@ UNIT_TEST(coroutine_two) {
   TEST_EQ(7, *i);
 }
 
+// Test that a script can keep its thread after the coroutine finished
+UNIT_TEST(coroutine_stale_thread) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "return function(x)                                  \n"
+    "  if x then                                         \n"
+    "    kept = coroutine.running()                      \n"
+    "  else                                              \n"
+    "    coroutine.yield()                               \n"
+    "  end                                               \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+
+  primer::bound_function f{L};
+  TEST(f, "expected to find a function");
+
+  {
+    primer::coroutine c{f};
+    TEST_EXPECTED(c.call_no_ret(true));
+    TEST(!c, "expected dead coroutine");
+  }
+
+  // Start another coroutine, which stays suspended
+  primer::coroutine d{f};
+  TEST_EXPECTED(d.call_no_ret());
+  TEST(d, "expected valid coroutine");
+
+#if PRIMER_COROUTINE_POOL_SIZE == 0
+  TEST_LUA_OK(L, luaL_loadstring(L, "return coroutine.status(kept)"));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  TEST_EQ(std::string{lua_tostring(L, -1)}, "dead");
+  lua_pop(L, 1);
+#endif
+
+  CHECK_STACK(L, 0);
+}
+
+namespace {
+
+int line_events = 0;
+
+void
+count_lines(lua_State *, lua_Debug *) {
+  ++line_events;
+}
+
+} // end anonymous namespace
+
+#if PRIMER_COROUTINE_POOL_SIZE
+// Test that threads of finished coroutines are reused
+UNIT_TEST(coroutine_pool) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "return function(x)                                  \n"
+    "  if x == 'yield' then coroutine.yield() end        \n"
+    "  if x == 'error' then                              \n"
+    "    errored = coroutine.running()                   \n"
+    "    error('oops')                                   \n"
+    "  end                                               \n"
+    "  return (coroutine.running())                      \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+
+  primer::bound_function f{L};
+  TEST(f, "expected to find a function");
+
+  CHECK_STACK(L, 0);
+
+  auto get_thread = [&](primer::expected<primer::lua_ref> & r) {
+    r->push();
+    lua_State * T = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    return T;
+  };
+
+  primer::expected<primer::lua_ref> r1;
+  {
+    primer::coroutine c{f};
+    r1 = c.call_one_ret();
+    TEST_EXPECTED(r1);
+    TEST(!c, "expected dead coroutine");
+  }
+  lua_State * T1 = get_thread(r1);
+  TEST(T1, "expected a thread");
+  CHECK_STACK(L, 0);
+
+  // A finished thread is handed out again
+  {
+    primer::coroutine c{f};
+    auto r2 = c.call_one_ret();
+    TEST_EXPECTED(r2);
+    TEST_EQ(T1, get_thread(r2));
+  }
+  CHECK_STACK(L, 0);
+
+  // A reused thread gets the hook of the parent state, like a new one
+  {
+    lua_sethook(L, &count_lines, LUA_MASKLINE, 0);
+    primer::coroutine c{f};
+    line_events = 0;
+    auto r = c.call_one_ret();
+    TEST_EXPECTED(r);
+    TEST_EQ(T1, get_thread(r));
+    TEST(line_events > 0, "expected line events");
+    TEST(lua_gethook(T1) == &count_lines, "expected the hook to be kept");
+
+    lua_sethook(L, nullptr, 0, 0);
+    primer::coroutine d{f};
+    auto r2 = d.call_one_ret();
+    TEST_EXPECTED(r2);
+    TEST_EQ(T1, get_thread(r2));
+    TEST(!lua_gethook(T1), "expected no hook");
+  }
+  CHECK_STACK(L, 0);
+
+  // A yielded thread is not shared with a new coroutine
+  {
+    primer::coroutine c{f};
+    auto y = c.call_no_ret("yield");
+    TEST_EXPECTED(y);
+    TEST(c, "expected valid coroutine");
+
+    primer::coroutine d{f};
+    auto r3 = d.call_one_ret();
+    TEST_EXPECTED(r3);
+
+    auto r4 = c.call_one_ret();
+    TEST_EXPECTED(r4);
+    TEST(get_thread(r3) != get_thread(r4), "expected different threads");
+  }
+  CHECK_STACK(L, 0);
+
+  // A thread which raised an error is not reused
+  {
+    primer::coroutine c{f};
+    auto e = c.call_one_ret("error");
+    TEST(!e, "expected an error");
+    TEST(!c, "expected dead coroutine");
+
+    lua_getglobal(L, "errored");
+    lua_State * T5 = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    TEST(T5, "expected a thread");
+
+    primer::coroutine d{f};
+    auto r6 = d.call_one_ret();
+    TEST_EXPECTED(r6);
+    TEST(T5 != get_thread(r6), "expected a different thread");
+  }
+  CHECK_STACK(L, 0);
+}
+#endif // PRIMER_COROUTINE_POOL_SIZE
+
+// Test that a budget preempts long running coroutines
+UNIT_TEST(coroutine_budget) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+  luaL_requiref(L, "coroutine", luaopen_coroutine, 1);
+  lua_pop(L, 1);
+
+  const char * script =
+    "return function(n)                                  \n"
+    "  local s = 0                                       \n"
+    "  for i = 1, n do                                   \n"
+    "    s = s + i                                       \n"
+    "    if i == n // 2 then coroutine.yield('half') end \n"
+    "  end                                               \n"
+    "  return s                                          \n"
+    "end                                                 \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function f{L};
+
+  TEST_LUA_OK(L, luaL_loadstring(L, "return function() while true do end end"));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function g{L};
+
+  CHECK_STACK(L, 0);
+
+  // Without a budget, nothing changes
+  {
+    primer::coroutine c{f};
+    auto r = c.call_one_ret(100000);
+    TEST_EXPECTED(r);
+    TEST(!c.preempted(), "unexpected preemption");
+    TEST_EQ("half", *r->as<std::string>());
+  }
+
+  // With an instruction budget, the work is split over many calls, and
+  // arguments to preempted calls are discarded
+  {
+    primer::budget b;
+    b.instructions = 1000;
+    b.check_interval = 100;
+
+    primer::coroutine c{f};
+    c.set_budget(b);
+
+    int preemptions = 0;
+    int yields = 0;
+    primer::expected<primer::lua_ref> r = c.call_one_ret(100000);
+    while (c) {
+      TEST_EXPECTED(r);
+      if (c.preempted()) {
+        ++preemptions;
+        TEST(!*r, "expected no value from a preempted call");
+      } else {
+        ++yields;
+        TEST_EQ("half", *r->as<std::string>());
+      }
+      r = c.call_one_ret("ignored");
+    }
+    TEST_EXPECTED(r);
+    TEST_EQ(1, yields);
+    TEST(preemptions > 100, "expected many preemptions, found " << preemptions);
+    TEST_EQ(5000050000LL, *r->as<long long>());
+    CHECK_STACK(L, 0);
+  }
+
+  // A time budget stops an infinite loop
+  {
+    primer::budget b;
+    b.time = std::chrono::milliseconds(5);
+
+    primer::coroutine c{g};
+    c.set_budget(b);
+
+    for (int i = 0; i < 3; ++i) {
+      auto r = c.call_no_ret();
+      TEST_EXPECTED(r);
+      TEST(c.preempted(), "expected preemption");
+      TEST(c, "expected valid coroutine");
+    }
+    CHECK_STACK(L, 0);
+  }
+
+  // A hook set on the thread keeps its line events and is restored. Threads
+  // created during the budget drop the budget hook once it is over.
+  {
+    lua_State * T = lua_newthread(L);
+    lua_sethook(T, &count_lines, LUA_MASKLINE, 0);
+
+    const char * script2 =
+      "inner = coroutine.create(function()               \n"
+      "  coroutine.yield()                               \n"
+      "  for i = 1, 1000 do end                          \n"
+      "end)                                              \n"
+      "coroutine.resume(inner)                           \n";
+    TEST_LUA_OK(T, luaL_loadstring(T, script2));
+
+    primer::budget b;
+    b.instructions = 1000000;
+    line_events = 0;
+    {
+      primer::detail::budget_scope scope{T, b};
+      TEST_LUA_OK(T, lua_resume(T, nullptr, 0));
+      TEST(!scope.preempted(), "unexpected preemption");
+    }
+    TEST(line_events > 0, "expected line events");
+    TEST(lua_gethook(T) == &count_lines, "expected the hook to be restored");
+    TEST_EQ(LUA_MASKLINE, lua_gethookmask(T));
+
+    lua_getglobal(L, "inner");
+    lua_State * inner = lua_tothread(L, -1);
+    TEST(inner, "expected a thread");
+    TEST_LUA_OK(inner, lua_resume(inner, L, 0));
+    TEST(!lua_gethook(inner), "expected the budget hook to be removed");
+    lua_pop(L, 2);
+    CHECK_STACK(L, 0);
+  }
+}
+
+namespace {
+
+std::vector<primer::completion<int>> pending_ints;
+std::vector<primer::completion<std::tuple<int, std::string>>> pending_pairs;
+
+primer::completion<int>
+fetch_int(lua_State *, int key) {
+  primer::completion<int> c;
+  if (key == 0) {
+    c.complete(100);
+  } else {
+    pending_ints.push_back(c);
+  }
+  return c;
+}
+
+primer::completion<std::tuple<int, std::string>>
+fetch_pair(lua_State *) {
+  primer::completion<std::tuple<int, std::string>> c;
+  pending_pairs.push_back(c);
+  return c;
+}
+
+} // end anonymous namespace
+
+// Test that adapted callbacks can suspend a coroutine until completion
+UNIT_TEST(completion_yield) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&fetch_int));
+  lua_setglobal(L, "fetch_int");
+  lua_pushcfunction(L, PRIMER_ADAPT(&fetch_pair));
+  lua_setglobal(L, "fetch_pair");
+
+  auto start = [&](const char * script) {
+    lua_State * T = lua_newthread(L);
+    TEST_LUA_OK(T, luaL_loadstring(T, script));
+    TEST_EQ(LUA_YIELD, lua_resume(T, nullptr, 0));
+    TEST_EQ(1, lua_gettop(T));
+    TEST(primer::async_op::test(T, -1), "expected an async_op");
+    lua_pop(T, 1);
+    return T;
+  };
+
+  {
+    lua_State * T = start("return fetch_int(3) + 1");
+    TEST_EQ(1u, pending_ints.size());
+    pending_ints[0].complete(42);
+    pending_ints.clear();
+
+    TEST_LUA_OK(T, lua_resume(T, nullptr, 0));
+    TEST_EQ(1, lua_gettop(T));
+    TEST_EQ(43, lua_tointeger(T, -1));
+    lua_pop(L, 1);
+  }
+
+  {
+    lua_State * T = start("local a, b = fetch_pair(); return b .. a");
+    pending_pairs[0].complete(std::make_tuple(5, std::string{"x"}));
+    pending_pairs.clear();
+
+    TEST_LUA_OK(T, lua_resume(T, nullptr, 0));
+    TEST_EQ(std::string{"x5"}, lua_tostring(T, -1));
+    lua_pop(L, 1);
+  }
+
+  // Failure raises an error in the script
+  {
+    lua_State * T = start("local ok, e = pcall(fetch_int, 1); return e");
+    pending_ints[0].fail(primer::error{"boom"});
+    pending_ints.clear();
+
+    TEST_LUA_OK(T, lua_resume(T, nullptr, 0));
+    TEST_EQ(std::string{"boom"}, lua_tostring(T, -1));
+    lua_pop(L, 1);
+  }
+
+  // Resuming early is an error
+  {
+    lua_State * T = start("return fetch_int(2)");
+    TEST_EQ(LUA_ERRRUN, lua_resume(T, nullptr, 0));
+    pending_ints.clear();
+    lua_pop(L, 1);
+  }
+
+  // Already complete, no yield
+  TEST_LUA_OK(L, luaL_dostring(L, "return fetch_int(0)"));
+  TEST_EQ(100, lua_tointeger(L, -1));
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+// Test that other threads can call into a VM through an executor
+UNIT_TEST(executor) {
+  lua_raii L;
+
+  TEST_LUA_OK(L, luaL_loadstring(L, "return function(a, b) return a + b end"));
+  TEST_LUA_OK(L, primer::protected_call(L, 0, 1));
+  primer::bound_function add{L};
+
+  TEST_LUA_OK(L, luaL_loadstring(L, "count = (count or 0) + 1"));
+  primer::bound_function incr{L};
+
+  TEST_LUA_OK(L, luaL_loadstring(L, "error('oops')"));
+  primer::bound_function fail{L};
+
+  CHECK_STACK(L, 0);
+
+  primer::executor ex{L};
+
+  // Requests from many threads
+  {
+    constexpr int num_threads = 4;
+    constexpr int num_requests = 250;
+
+    std::vector<std::future<primer::expected<int>>> futures[num_threads];
+    std::vector<std::thread> threads;
+    std::atomic<int> finished{0};
+
+    for (int t = 0; t < num_threads; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; i < num_requests; ++i) {
+          futures[t].push_back(ex.post<int>(add, t, i));
+          ex.post(incr);
+        }
+        ++finished;
+      });
+    }
+
+    std::size_t total = 0;
+    while (finished < num_threads || !ex.empty()) {
+      std::size_t n = ex.run_pending(16);
+      TEST(n <= 16, "batch size was exceeded");
+      total += n;
+    }
+    total += ex.run_pending();
+    for (auto & th : threads) {
+      th.join();
+    }
+    total += ex.run_pending();
+
+    TEST_EQ(2 * num_threads * num_requests, total);
+    for (int t = 0; t < num_threads; ++t) {
+      TEST_EQ(num_requests, futures[t].size());
+      for (int i = 0; i < num_requests; ++i) {
+        auto r = futures[t][i].get();
+        TEST_EXPECTED(r);
+        TEST_EQ(t + i, *r);
+      }
+    }
+
+    lua_getglobal(L, "count");
+    TEST_EQ(num_threads * num_requests, lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    CHECK_STACK(L, 0);
+  }
+
+  // Errors are reported through the future
+  {
+    auto f1 = ex.post(fail);
+    auto f2 = ex.post<int>(add, "a", 1);
+    auto f3 = ex.post<std::string>(add, 1, 2);
+    TEST_EQ(3, ex.run_pending());
+
+    auto r1 = f1.get();
+    TEST(!r1, "expected an error");
+    TEST(r1.err().str().find("oops") != std::string::npos,
+         "unexpected message: " << r1.err().str());
+    TEST(!f2.get(), "expected an error");
+    TEST(!f3.get(), "expected an error");
+    CHECK_STACK(L, 0);
+  }
+
+  // Functions from another VM are rejected, and pending requests are failed
+  // when the executor is destroyed
+  {
+    lua_raii L2;
+    primer::executor ex2{L2};
+    auto f1 = ex2.post<int>(add, 1, 2);
+    TEST_EQ(1, ex2.run_pending());
+    TEST(!f1.get(), "expected an error");
+
+    std::future<primer::expected<void>> f2;
+    {
+      primer::executor ex3{L};
+      f2 = ex3.post(incr);
+    }
+    TEST(!f2.get(), "expected an error");
+  }
+}
+
 // This test catches a subtle issue regarding whether or not cpp_pcall
 // messes up the stack when it returns.
 UNIT_TEST(cpp_pcall_returns) {
@@ -6,7 +6,9 @@
 #include <string>
 
 #include <array>
+#include <cstring>
 #include <map>
+#include <new>
 #include <set>
 #include <vector>
 
@@ -312,6 +314,22 @@ test_vector_round_trip() {
                    __LINE__);
 }
 
+// Errors in nested containers carry one line of context per level
+void
+test_nested_read_error() {
+  lua_raii L;
+
+  TEST_LUA_OK(L, luaL_dostring(L, "return { {1, 2}, {3, {}} }"));
+  auto result = primer::read<std::vector<std::vector<int>>>(L, -1);
+  lua_pop(L, 1);
+  TEST(!result, "expected failure");
+  TEST_EQ("In index [2],\n"
+          "In index [2],\n"
+          "Expected integer found: 'table'",
+          result.err().str());
+  CHECK_STACK(L, 0);
+}
+
 void
 test_array_round_trip() {
   lua_raii L;
@@ -605,6 +623,231 @@ test_userdata_two() {
   CHECK_STACK(L, 0);
 }
 
+void
+test_userdata_type_check() {
+  lua_raii L;
+
+  primer::push_udata<vec2_test>(L, 1.0f, 2.0f);
+  primer::push_udata<userdata_test>(L);
+  lua_pushlightuserdata(L, lua_touserdata(L, 1));
+  // A foreign userdata with the same size as a vec2
+  constexpr std::size_t size = primer::detail::udata_tag<vec2_test>::block_size;
+  std::memset(lua_newuserdata(L, size), 0, size);
+  lua_pushinteger(L, 5);
+
+  CHECK_STACK(L, 5);
+
+  TEST(primer::test_udata<vec2_test>(L, 1), "did not recognize vec2");
+  TEST(primer::test_udata<userdata_test>(L, 2), "did not recognize udata");
+  TEST(!primer::test_udata<vec2_test>(L, 2), "mistook udata for vec2");
+  TEST(!primer::test_udata<userdata_test>(L, 1), "mistook vec2 for udata");
+  TEST(!primer::test_udata<vec2_test>(L, 3), "mistook light userdata");
+  TEST(!primer::test_udata<vec2_test>(L, 4), "mistook foreign userdata");
+  TEST(!primer::test_udata<vec2_test>(L, 5), "mistook a number");
+
+  TEST_EQ(primer::test_udata<vec2_test>(L, 1)->y, 2.0f);
+
+  auto r = primer::read<vec2_test &>(L, 2);
+  TEST(!r, "expected an error");
+  TEST_EQ(std::string{r.err().what()},
+          "Expected userdata 'vec2', found userdata");
+
+  CHECK_STACK(L, 5);
+}
+
+// Userdata created without primer, or persisted before tags, have no tag
+void
+test_userdata_untagged() {
+  lua_raii L;
+
+  // Create the metatables
+  primer::push_udata<vec2_test>(L, 0.0f, 0.0f);
+  primer::push_udata<userdata_test>(L);
+  lua_pop(L, 2);
+
+  new (lua_newuserdata(L, sizeof(vec2_test))) vec2_test{3.0f, 4.0f};
+  luaL_setmetatable(L, "vec2");
+  new (lua_newuserdata(L, sizeof(userdata_test))) userdata_test();
+  luaL_setmetatable(L, "userdata_test_type");
+
+  TEST(primer::test_udata<vec2_test>(L, 1), "did not recognize vec2");
+  TEST_EQ(primer::test_udata<vec2_test>(L, 1)->y, 4.0f);
+  TEST(!primer::test_udata<userdata_test>(L, 1), "mistook vec2 for udata");
+  TEST(primer::test_udata<userdata_test>(L, 2), "did not recognize udata");
+  auto r = primer::read<vec2_test &>(L, 1);
+  TEST_EXPECTED(r);
+
+  // Collecting them runs the destructors, and writes nothing past the object
+  primer::test_udata<userdata_test>(L, 2)->list.push_back(
+    "a string which is too long for the small string buffer");
+  lua_pop(L, 2);
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  CHECK_STACK(L, 0);
+}
+
+/***
+ * Userdata with bases
+ */
+
+struct shape_test {
+  int sides;
+
+  primer::result get_sides(lua_State * L) {
+    lua_pushinteger(L, sides);
+    return 1;
+  }
+
+  primer::result describe(lua_State * L) {
+    lua_pushstring(L, "shape");
+    return 1;
+  }
+};
+
+struct label_test {
+  std::string label;
+
+  primer::result get_label(lua_State * L) {
+    lua_pushstring(L, label.c_str());
+    return 1;
+  }
+};
+
+struct square_test : shape_test, label_test {
+  float side;
+
+  square_test(float s, std::string l)
+    : shape_test{4}
+    , label_test{std::move(l)}
+    , side(s) {}
+
+  primer::result area(lua_State * L) {
+    lua_pushnumber(L, side * side);
+    return 1;
+  }
+
+  primer::result describe(lua_State * L) {
+    lua_pushstring(L, "square");
+    return 1;
+  }
+};
+
+struct tile_test : square_test {
+  int color;
+
+  tile_test(float s, int c)
+    : square_test(s, "tile")
+    , color(c) {}
+};
+
+static constexpr luaL_Reg shape_methods[] = {
+  {"sides", PRIMER_ADAPT_USERDATA(shape_test, &shape_test::get_sides)},
+  {"describe", PRIMER_ADAPT_USERDATA(shape_test, &shape_test::describe)},
+  {nullptr, nullptr}};
+
+static constexpr luaL_Reg label_methods[] = {
+  {"label", PRIMER_ADAPT_USERDATA(label_test, &label_test::get_label)},
+  {nullptr, nullptr}};
+
+static constexpr luaL_Reg square_methods[] = {
+  {"area", PRIMER_ADAPT_USERDATA(square_test, &square_test::area)},
+  {"describe", PRIMER_ADAPT_USERDATA(square_test, &square_test::describe)},
+  {nullptr, nullptr}};
+
+namespace primer {
+namespace traits {
+
+template <>
+struct userdata<shape_test> {
+  static constexpr const char * name = "shape";
+  static constexpr const luaL_Reg * metatable = shape_methods;
+};
+
+template <>
+struct userdata<label_test> {
+  static constexpr const char * name = "label";
+  static constexpr const luaL_Reg * metatable = label_methods;
+};
+
+template <>
+struct userdata<square_test> {
+  static constexpr const char * name = "square";
+  static constexpr const luaL_Reg * metatable = square_methods;
+  using bases = primer::bases<shape_test, label_test>;
+};
+
+template <>
+struct userdata<tile_test> {
+  static constexpr const char * name = "tile";
+  using bases = primer::bases<square_test>;
+};
+
+} // end namespace traits
+} // end namespace primer
+
+void
+test_userdata_inheritance() {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+
+  primer::push_udata<square_test>(L, 3.0f, "sq");
+  primer::push_udata<tile_test>(L, 2.0f, 7);
+  primer::push_udata<shape_test>(L, shape_test{3});
+
+  CHECK_STACK(L, 3);
+
+  {
+    square_test * sq = primer::test_udata<square_test>(L, 1);
+    TEST(sq, "did not recognize square");
+    TEST_EQ(primer::test_udata<shape_test>(L, 1),
+            static_cast<shape_test *>(sq));
+    TEST_EQ(primer::test_udata<label_test>(L, 1),
+            static_cast<label_test *>(sq));
+    TEST(!primer::test_udata<tile_test>(L, 1), "mistook square for tile");
+  }
+
+  {
+    tile_test * t = primer::test_udata<tile_test>(L, 2);
+    TEST(t, "did not recognize tile");
+    TEST_EQ(primer::test_udata<square_test>(L, 2),
+            static_cast<square_test *>(t));
+    TEST_EQ(primer::test_udata<label_test>(L, 2),
+            static_cast<label_test *>(t));
+    TEST_EQ(primer::test_udata<label_test>(L, 2)->label, "tile");
+  }
+
+  TEST(primer::test_udata<shape_test>(L, 3), "did not recognize shape");
+  TEST(!primer::test_udata<square_test>(L, 3), "mistook shape for square");
+  TEST(!primer::test_udata<label_test>(L, 3), "mistook shape for label");
+
+  lua_setglobal(L, "h");
+  lua_setglobal(L, "t");
+  lua_setglobal(L, "s");
+  CHECK_STACK(L, 0);
+
+  const char * const script =
+    ""
+    "assert(s:sides() == 4)                         \n"
+    "assert(s:label() == 'sq')                      \n"
+    "assert(s:area() == 9)                          \n"
+    "assert(s:describe() == 'square')               \n"
+    "assert(t:sides() == 4)                         \n"
+    "assert(t:label() == 'tile')                    \n"
+    "assert(t:area() == 4)                          \n"
+    "assert(t:describe() == 'square')               \n"
+    "assert(h:sides() == 3)                         \n"
+    "assert(h:describe() == 'shape')                \n"
+    "assert(h.area == nil)                          \n"
+    "assert(not pcall(s.area, h))                   \n";
+
+  TEST_EXPECTED(try_load_script(L, script));
+  auto result = primer::fcn_call_no_ret(L, 0);
+  TEST_EXPECTED(result);
+
+  CHECK_STACK(L, 0);
+}
+
 void
 test_std_function() {
   lua_raii L;
@@ -659,6 +902,7 @@ main() {
     {"map push", &test_map_push},
     {"set push", &test_set_push},
     {"vector roundtrip", &test_vector_round_trip},
+    {"nested read error", &test_nested_read_error},
     {"array roundtrip", &test_array_round_trip},
     {"pair roundtrip", &test_pair_round_trip},
     {"map roundtrip", &test_map_round_trip},
@@ -666,6 +910,9 @@ main() {
     {"unordered map roundtrip", &test_map_round_trip},
     {"userdata", &test_userdata},
     {"userdata two", &test_userdata_two},
+    {"userdata type check", &test_userdata_type_check},
+    {"userdata untagged", &test_userdata_untagged},
+    {"userdata inheritance", &test_userdata_inheritance},
     {"std function", &test_std_function},
   };
   int num_fails = tests.run();
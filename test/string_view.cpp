@@ -0,0 +1,109 @@
+#include <primer/primer.hpp>
+#include <primer/std.hpp>
+
+#include "test_harness/test_harness.hpp"
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/***
+ * Test binary-safe strings
+ */
+
+UNIT_TEST(string_embedded_zeros) {
+  lua_raii L;
+
+  const std::string s{"abc\0def", 7};
+  primer::push(L, s);
+  TEST_EQ(7u, lua_rawlen(L, -1));
+
+  auto r = primer::read<std::string>(L, -1);
+  TEST_EXPECTED(r);
+  TEST_EQ(s, *r);
+  lua_pop(L, 1);
+
+  std::vector<std::string> v{s, std::string{"\0", 1}};
+  primer::push(L, v);
+  auto rv = primer::read<std::vector<std::string>>(L, -1);
+  TEST_EXPECTED(rv);
+  TEST_EQ(2u, rv->size());
+  TEST_EQ(s, rv->at(0));
+  TEST_EQ(1u, rv->at(1).size());
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+UNIT_TEST(string_view_roundtrip) {
+  lua_raii L;
+
+  const std::string_view sv{"xyz\0w", 5};
+  primer::push(L, sv);
+  TEST_EQ(5u, lua_rawlen(L, -1));
+
+  auto r = primer::read<std::string_view>(L, -1);
+  TEST_EXPECTED(r);
+  TEST_EQ(sv, *r);
+
+  // The view refers to the lua string, no copy is made
+  TEST(r->data() == lua_tostring(L, -1), "expected no copy");
+  lua_pop(L, 1);
+
+  lua_pushinteger(L, 5);
+  TEST(!primer::read<std::string_view>(L, -1), "expected failure");
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+namespace {
+
+std::size_t payload_size;
+std::size_t payload_zeros;
+
+primer::result
+count_zeros(lua_State * L, std::string_view payload) {
+  payload_size = payload.size();
+  payload_zeros = 0;
+  for (char c : payload) {
+    if (!c) { ++payload_zeros; }
+  }
+  primer::push(L, payload.substr(0, 2));
+  return 1;
+}
+
+} // end anonymous namespace
+
+UNIT_TEST(string_view_callback) {
+  lua_raii L;
+
+  luaL_requiref(L, "", &luaopen_base, 1);
+  lua_pop(L, 1);
+  luaL_requiref(L, "string", &luaopen_string, 1);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, PRIMER_ADAPT(&count_zeros));
+  lua_setglobal(L, "f");
+
+  TEST_LUA_OK(L, luaL_dostring(L, "return f(string.rep('a\\0', 1000))"));
+  TEST_EQ(2000u, payload_size);
+  TEST_EQ(1000u, payload_zeros);
+  TEST_EQ(2u, lua_rawlen(L, -1));
+  lua_pop(L, 1);
+
+  TEST_LUA_OK(L, luaL_dostring(L, "return (pcall(f, {}))"));
+  TEST_EQ(false, lua_toboolean(L, -1));
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+int
+main() {
+  conf::log_conf();
+
+  std::cout << "String view tests:" << std::endl;
+  return test_registrar::run_tests();
+}
@@ -1,8 +1,11 @@
 #include <primer/primer.hpp>
 #include <primer/visit_struct.hpp>
 
+#include <primer/api/base.hpp>
 #include <primer/api/callback_registrar.hpp>
 #include <primer/api/callbacks.hpp>
+#include <primer/api/libraries.hpp>
+#include <primer/api/userdatas.hpp>
 
 #include "test_harness/test_harness.hpp"
 #include <iostream>
@@ -369,6 +372,243 @@ UNIT_TEST(api_callbacks) {
   TEST_EQ(4, a.internal_state_);
 }
 
+/***
+ * Visitable userdata
+ */
+
+namespace test {
+
+struct particle {
+  BEGIN_VISITABLES(particle);
+  VISITABLE(double, x);
+  VISITABLE(double, y);
+  VISITABLE(std::string, label);
+  END_VISITABLES;
+};
+
+primer::result
+particle_norm2(lua_State * L, particle & p) {
+  lua_pushnumber(L, p.x * p.x + p.y * p.y);
+  return 1;
+}
+
+// A method which shadows a field
+primer::result
+particle_label(lua_State * L, particle &) {
+  lua_pushstring(L, "method");
+  return 1;
+}
+
+const luaL_Reg particle_methods[] = {
+  {"norm2", PRIMER_ADAPT(&particle_norm2)},
+  {"label", PRIMER_ADAPT(&particle_label)},
+  {nullptr, nullptr}};
+
+struct point {
+  BEGIN_VISITABLES(point);
+  VISITABLE(int, i);
+  VISITABLE(int, j);
+  END_VISITABLES;
+};
+
+} // end namespace test
+
+namespace primer {
+namespace traits {
+
+template <>
+struct userdata<test::particle> {
+  static constexpr const char * name = "particle";
+  static constexpr const luaL_Reg * metatable = test::particle_methods;
+  static constexpr bool auto_persist = true;
+};
+
+template <>
+struct userdata<test::point> {
+  static constexpr const char * name = "point";
+};
+
+} // end namespace traits
+} // end namespace primer
+
+UNIT_TEST(visitable_userdata_fields) {
+  lua_raii L;
+
+  luaL_requiref(L, "", luaopen_base, 1);
+  lua_pop(L, 1);
+
+  primer::push_udata<test::particle>(L, test::particle{3, 4, "p"});
+  lua_setglobal(L, "p");
+  primer::push_udata<test::point>(L, test::point{1, 2});
+  lua_setglobal(L, "q");
+  CHECK_STACK(L, 0);
+
+  const char * script =
+    ""
+    "assert(p.x == 3 and p.y == 4)                         \n"
+    "assert(p:norm2() == 25)                               \n"
+    "assert(p:label() == 'method')                         \n"
+    "assert(p.nothing == nil)                              \n"
+    "p.x = 6; p.y = 8                                      \n"
+    "assert(p:norm2() == 100)                              \n"
+    "assert(q.i == 1 and q.j == 2)                         \n"
+    "q.i = q.i + q.j                                       \n"
+    "assert(q.i == 3)                                      \n"
+    "assert(not pcall(function() p.z = 1 end))             \n"
+    "local ok, err = pcall(function() q.j = 'a' end)       \n"
+    "assert(not ok)                                        \n"
+    "return err                                            \n";
+
+  TEST_LUA_OK(L, luaL_loadstring(L, script));
+  TEST_LUA_OK(L, lua_pcall(L, 0, 1, 0));
+  TEST(lua_isstring(L, -1), "expected an error message");
+  TEST(std::string{lua_tostring(L, -1)}.find("In field name 'j'")
+         != std::string::npos,
+       "unexpected error message: " << lua_tostring(L, -1));
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "p");
+  test::particle * p = primer::test_udata<test::particle>(L, -1);
+  TEST(p, "expected a particle");
+  TEST_EQ(p->x, 6);
+  TEST_EQ(p->y, 8);
+  TEST_EQ(p->label, "p");
+  lua_pop(L, 1);
+
+  lua_getglobal(L, "q");
+  test::point * q = primer::test_udata<test::point>(L, -1);
+  TEST(q, "expected a point");
+  TEST_EQ(q->i, 3);
+  TEST_EQ(q->j, 2);
+  lua_pop(L, 1);
+
+  CHECK_STACK(L, 0);
+}
+
+/***
+ * Generated persistence
+ */
+
+namespace test {
+
+// Trivially copyable, and not visitable
+struct cell {
+  int row;
+  int col;
+  double value;
+};
+
+primer::result
+cell_sum(lua_State * L, cell & c) {
+  lua_pushnumber(L, c.row + c.col + c.value);
+  return 1;
+}
+
+const luaL_Reg cell_methods[] = {{"sum", PRIMER_ADAPT(&cell_sum)},
+                                 {nullptr, nullptr}};
+
+} // end namespace test
+
+namespace primer {
+namespace traits {
+
+template <>
+struct userdata<test::cell> {
+  static constexpr const char * name = "cell";
+  static constexpr const luaL_Reg * metatable = test::cell_methods;
+  static constexpr bool auto_persist = true;
+};
+
+template <>
+struct userdata<test::bar> {
+  static constexpr const char * name = "bar";
+  static constexpr bool auto_persist = true;
+};
+
+} // end namespace traits
+} // end namespace primer
+
+static_assert(primer::detail::auto_persist_enabled<test::cell>::value, "");
+static_assert(!primer::detail::auto_persist_enabled<test::point>::value, "");
+static_assert(primer::detail::has_field_codec<test::point>::value, "");
+static_assert(!primer::detail::has_field_codec<test::cell>::value, "");
+
+struct test_api_persist : primer::api::base<test_api_persist> {
+  using udatas_t =
+    primer::api::userdatas<test::particle, test::cell, test::bar>;
+
+  lua_raii L_;
+
+  API_FEATURE(primer::api::libraries<primer::api::lua_base_lib>, libs_);
+  API_FEATURE(udatas_t, udata_);
+
+  test_api_persist()
+    : L_() {
+    this->initialize_api(L_);
+  }
+
+  std::string save() {
+    std::string result;
+    this->persist(L_, result);
+    return result;
+  }
+
+  void restore(const std::string & buffer) { this->unpersist(L_, buffer); }
+};
+
+UNIT_TEST(visitable_userdata_auto_persist) {
+  std::string buffer;
+
+  {
+    test_api_persist a;
+    lua_State * L = a.L_;
+
+    primer::push_udata<test::particle>(L, test::particle{1.5, -2, "part"});
+    lua_setglobal(L, "p");
+    primer::push_udata<test::cell>(L, test::cell{3, 4, 0.25});
+    lua_setglobal(L, "c");
+    primer::push_udata<test::bar>(
+      L, test::bar{"bar", test::foo{true, 7, 1.5f}, test::foo{false, -1, 0}});
+    lua_setglobal(L, "b");
+    CHECK_STACK(L, 0);
+
+    buffer = a.save();
+  }
+
+  {
+    test_api_persist a;
+    a.restore(buffer);
+    lua_State * L = a.L_;
+
+    const char * script =
+      ""
+      "assert(p.x == 1.5 and p.y == -2)                        \n"
+      "assert(p:norm2() == 6.25)                               \n"
+      "assert(c:sum() == 7.25)                                 \n"
+      "assert(b.d == 'bar')                                    \n"
+      "assert(b.e.a == 7 and b.e.b == true and b.e.c == 1.5)   \n"
+      "assert(b.f.a == -1 and b.f.b == false)                  \n";
+
+    TEST_LUA_OK(L, luaL_loadstring(L, script));
+    TEST_LUA_OK(L, lua_pcall(L, 0, 0, 0));
+
+    lua_getglobal(L, "p");
+    test::particle * p = primer::test_udata<test::particle>(L, -1);
+    TEST(p, "expected a particle");
+    TEST_EQ(p->label, "part");
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "c");
+    test::cell * c = primer::test_udata<test::cell>(L, -1);
+    TEST(c, "expected a cell");
+    TEST_EQ(c->row, 3);
+    TEST_EQ(c->col, 4);
+    lua_pop(L, 1);
+
+    CHECK_STACK(L, 0);
+  }
+}
+
 int
 main() {
   conf::log_conf();